@@ -0,0 +1,106 @@
+/**********************************************************************
+ * Copyright (c) 2020-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN	16
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;	/* Bytes in @data */
+	size_t used;
+	size_t __pad;	/* Keep @data aligned to ARENA_ALIGN */
+	char data[];
+};
+
+static struct arena_chunk *__new_chunk(size_t size)
+{
+	struct arena_chunk *chunk = malloc(sizeof(*chunk) + size);
+
+	if (!chunk) return NULL;
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_chunk *chunk = arena->head;
+	void *ptr;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		size_t chunk_size = chunk ? chunk->size * 2 : ARENA_MIN_CHUNK;
+
+		while (chunk_size < size) chunk_size *= 2;
+		chunk = __new_chunk(chunk_size);
+		if (!chunk) return NULL;
+		chunk->next = arena->head;
+		arena->head = chunk;
+	}
+	ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	arena->used += size;
+
+	return ptr;
+}
+
+char *arena_strdup(struct arena *arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *dup = arena_alloc(arena, len);
+
+	if (dup) memcpy(dup, str, len);
+	return dup;
+}
+
+void arena_reset(struct arena *arena)
+{
+	struct arena_chunk *chunk = arena->head;
+
+	arena->used = 0;
+	if (!chunk) return;
+
+	if (chunk->next) {
+		size_t total = 0;
+
+		for (struct arena_chunk *c = chunk; c; c = c->next) {
+			total += c->size;
+		}
+		arena_destroy(arena);
+		arena->head = __new_chunk(total);
+		return;
+	}
+	chunk->used = 0;
+}
+
+void arena_destroy(struct arena *arena)
+{
+	struct arena_chunk *chunk = arena->head;
+
+	while (chunk) {
+		struct arena_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	arena->head = NULL;
+	arena->used = 0;
+}
@@ -0,0 +1,80 @@
+/**********************************************************************
+ * Copyright (c) 2020-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+#define ARENA_MIN_CHUNK	4096	/* Size of the first chunk of an arena */
+
+struct arena_chunk;
+
+/**
+ * A bump allocator. Objects are carved out of large chunks and are never
+ * freed one by one; the whole arena is reset or destroyed at once.
+ */
+struct arena {
+	struct arena_chunk *head;	/* Chunk being carved. Older ones follow */
+	size_t used;			/* Bytes handed out since the last reset */
+};
+
+#define ARENA_INIT { .head = NULL, .used = 0 }
+
+
+/***********************************************************************
+ * arena_alloc()
+ *
+ * DESCRIPTION
+ *  Allocate @size bytes aligned for any object from @arena. A new chunk,
+ *  at least twice as large as the current one, is added when the current
+ *  chunk is full.
+ *
+ * RETURN VALUE
+ *  Return the allocated memory, or NULL if a new chunk cannot be allocated
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+
+/***********************************************************************
+ * arena_strdup()
+ *
+ * DESCRIPTION
+ *  Duplicate @str into @arena.
+ */
+char *arena_strdup(struct arena *arena, const char *str);
+
+
+/***********************************************************************
+ * arena_reset()
+ *
+ * DESCRIPTION
+ *  Release everything allocated from @arena. The memory is kept for the
+ *  next round of allocations; if more than one chunk was used, they are
+ *  merged into a single chunk of the same total size so that a round of
+ *  the same size is served from one chunk next time.
+ */
+void arena_reset(struct arena *arena);
+
+
+/***********************************************************************
+ * arena_destroy()
+ *
+ * DESCRIPTION
+ *  Return all memory of @arena to the system.
+ */
+void arena_destroy(struct arena *arena);
+
+#endif
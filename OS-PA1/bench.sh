@@ -0,0 +1,101 @@
+#!/bin/sh
+#
+# Throughput benchmark of mash, driven by make bench. Each workload is a
+# generated script of toy (or builtin) commands that mash runs in batch
+# mode. Sizes can be changed with BENCH_COMMANDS and BENCH_PIPE_MB.
+#
+#  commands/sec	Lines of the script run per second, with tracing on
+#  spawn latency	fork (or posix_spawn) call to return in the shell, and
+#		to exec in the child, taken from the mash -T trace
+#  pipeline MB/s	Bytes through "toy -w | toy -r" per second
+#  pipe-map	Lines per second through grep, alone and under pipe-map
+#  glob		Commands per second globbing a directory of NR_COMMANDS * 50
+#		files, by a literal prefix and by a suffix
+#
+
+MASH=${MASH:-./mash}
+TOY=${TOY:-./toy}
+NR_COMMANDS=${BENCH_COMMANDS:-2000}
+PIPE_MB=${BENCH_PIPE_MB:-1024}
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+now_ns() {
+	date +%s%N
+}
+
+# gen <file> <header> <command>: <header> once, then <command> NR_COMMANDS times
+gen() {
+	awk -v n="$NR_COMMANDS" -v header="$2" -v cmd="$3" \
+		'BEGIN { if (header != "") print header; for (i = 0; i < n; i++) print cmd }' > "$1"
+}
+
+# run <name> <script>: run the script with tracing, print commands/sec
+run() {
+	start=$(now_ns)
+	$MASH -b "$2" -T "$tmp/$1.trace" > /dev/null || exit 1
+	end=$(now_ns)
+	awk -v name="$1" -v n="$NR_COMMANDS" -v ns=$((end - start)) \
+		'BEGIN { printf "%-24s %8d cmds %10.1f cmds/s\n", name, n, n / (ns / 1e9) }'
+}
+
+# latency <name> <from> <to>: percentiles of <to> - <from> over the children in the trace
+latency() {
+	grep -o "\"$2\":[0-9][0-9]*,[^}]*\"$3\":[0-9][0-9]*" "$tmp/$1.trace" |
+	awk -F'[:,]' -v from="\"$2\"" -v to="\"$3\"" '{
+		for (i = 1; i < NF; i += 2) t[$i] = $(i + 1)
+		print t[to] - t[from]
+	}' | sort -n |
+	awk -v name="$1 $2->$3" '{ v[NR] = $1 } END {
+		if (!NR) exit
+		printf "%-24s %8d procs  p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f us\n", name, NR,
+			v[int(NR * 0.50) + 1] / 1e3, v[int(NR * 0.90) + 1] / 1e3,
+			v[int(NR * 0.99) + 1] / 1e3, v[NR] / 1e3
+	}'
+}
+
+echo "== commands/sec"
+gen "$tmp/fork" "" "$TOY -q"
+run fork "$tmp/fork"
+gen "$tmp/posix_spawn" "set spawn posix_spawn" "$TOY -q"
+run posix_spawn "$tmp/posix_spawn"
+gen "$tmp/zygote" "set spawn zygote" "$TOY -q"
+run zygote "$tmp/zygote"
+gen "$tmp/builtin" "" "true"
+run builtin "$tmp/builtin"
+gen "$tmp/pipeline" "" "$TOY -q -w 4096 | $TOY -q -r | $TOY -q -r"
+run pipeline "$tmp/pipeline"
+gen "$tmp/alias" "alias t $TOY -q -c 1000" "t ; t && t"
+run alias "$tmp/alias"
+
+echo "== spawn latency"
+latency fork fork forked
+latency fork fork exec
+latency posix_spawn fork forked
+latency zygote fork forked
+
+echo "== pipeline MB/s"
+start=$(now_ns)
+echo "$TOY -q -w $((PIPE_MB << 20)) | $TOY -q -r" | $MASH -q || exit 1
+end=$(now_ns)
+awk -v mb="$PIPE_MB" -v ns=$((end - start)) \
+	'BEGIN { printf "%-24s %8d MB   %10.1f MB/s\n", "toy -w | toy -r", mb, mb / (ns / 1e9) }'
+
+echo "== filter through pipe-map"
+seq 1 $((NR_COMMANDS * 1000)) > "$tmp/lines"
+for cmd in "grep 7" "pipe-map grep 7" "pipe-map -k grep 7"; do
+	start=$(now_ns)
+	echo "cat $tmp/lines | $cmd | wc -l" | $MASH -q > /dev/null || exit 1
+	end=$(now_ns)
+	awk -v name="$cmd" -v n=$((NR_COMMANDS * 1000)) -v ns=$((end - start)) \
+		'BEGIN { printf "%-24s %8d lines %9.1f Mlines/s\n", name, n, n / 1e6 / (ns / 1e9) }'
+done
+
+echo "== glob over a large directory"
+mkdir "$tmp/dir" || exit 1
+(cd "$tmp/dir" && seq 1 $((NR_COMMANDS * 50)) | sed 's/^/f/' | xargs touch) || exit 1
+gen "$tmp/glob-prefix" "" "echo $tmp/dir/f1234*"
+run glob-prefix "$tmp/glob-prefix"
+gen "$tmp/glob-suffix" "" "echo $tmp/dir/*1234"
+run glob-suffix "$tmp/glob-suffix"
@@ -0,0 +1,150 @@
+/**********************************************************************
+ * Copyright (c) 2020-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+/**
+ * Reference client of mash -S. Send the lines from stdin to the server,
+ * and write what comes back to stdout and stderr. The result of each line
+ * goes to stderr with -v. Exit with the status of the last line.
+ *
+ * usage: client [-v] <socket>
+ */
+
+static bool verbose = false;
+
+static void __write_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) return;
+		buf += n;
+		len -= n;
+	}
+}
+
+/* Handle the complete frames in @buf, return the bytes consumed */
+static size_t __handle_frames(char *buf, size_t len, int *status)
+{
+	size_t pos = 0;
+
+	while (len - pos >= sizeof(struct mash_frame)) {
+		struct mash_frame frame;
+		struct mash_exit result;
+
+		memcpy(&frame, buf + pos, sizeof(frame));
+		if (len - pos - sizeof(frame) < frame.len) break;
+
+		switch (frame.type) {
+		case MASH_FRAME_STDOUT:
+			__write_all(STDOUT_FILENO, buf + pos + sizeof(frame), frame.len);
+			break;
+		case MASH_FRAME_STDERR:
+			__write_all(STDERR_FILENO, buf + pos + sizeof(frame), frame.len);
+			break;
+		case MASH_FRAME_EXIT:
+			memcpy(&result, buf + pos + sizeof(frame), sizeof(result));
+			*status = result.status;
+			if (verbose) {
+				fprintf(stderr, "[exit %d real %.3f ms user %.3f ms sys %.3f ms maxrss %lld KB]\n",
+						result.status, result.real_ns / 1e6,
+						result.utime_us / 1e3, result.stime_us / 1e3,
+						(long long)result.maxrss_kb);
+			}
+			break;
+		}
+		pos += sizeof(frame) + frame.len;
+	}
+	return pos;
+}
+
+int main(int argc, char * const argv[])
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	static char buf[1 << 20];
+	size_t len = 0;
+	int status = 0;
+	int sock;
+	int opt;
+	struct pollfd fds[2];
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v] <socket>\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind >= argc || strlen(argv[optind]) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "usage: %s [-v] <socket>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	strcpy(addr.sun_path, argv[optind]);
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("connect");
+		return EXIT_FAILURE;
+	}
+
+	/* Keep reading the replies while sending, or both sides may fill up */
+	fds[0] = (struct pollfd) { .fd = STDIN_FILENO, .events = POLLIN };
+	fds[1] = (struct pollfd) { .fd = sock, .events = POLLIN };
+	while (true) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (fds[0].revents) {
+			char line[4096];
+			ssize_t n = read(STDIN_FILENO, line, sizeof(line));
+
+			if (n > 0) {
+				__write_all(sock, line, n);
+			} else {
+				shutdown(sock, SHUT_WR);
+				fds[0].fd = -1;
+			}
+		}
+		if (fds[1].revents) {
+			ssize_t n = read(sock, buf + len, sizeof(buf) - len);
+			size_t used;
+
+			if (n <= 0) break;
+			len += n;
+			used = __handle_frames(buf, len, &status);
+			memmove(buf, buf + used, len - used);
+			len -= used;
+		}
+	}
+	close(sock);
+
+	return status;
+}
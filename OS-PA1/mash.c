@@ -16,16 +16,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <getopt.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "parser.h"
 
 extern int run_command(int nr_tokens, char *tokens[]);
 extern int initialize(int argc, char * const argv[]);
 extern void finalize(int argc, char * const argv[]);
+extern void notify_jobs(void);
+extern int open_trace(const char *path);
+extern int set_option(const char *name, const char *value);
+extern void trace_parse(unsigned long long read_ns, unsigned long long parsed_ns);
+extern int run_server(const char *path);
 
 static bool __verbose = true;
+static bool __trace = false;
 
 static const char *__color_start = "[0;31;40m";
 static const char *__color_end = "[0m";
@@ -38,16 +50,115 @@ static void __print_prompt(void)
 	fprintf(stderr, "%s%s%s ", __color_start, cwd, __color_end);
 }
 
+/**
+ * Script input. When commands come from a regular file, either given with
+ * -b or redirected to stdin, the whole file is mapped and split into lines
+ * here instead of reading stdin one byte at a time.
+ */
+struct script {
+	char *data;
+	size_t size;
+	size_t pos;	/* Offset of the next line */
+	int fd;		/* Shared with children; its offset follows @pos. -1 if not */
+};
+
+static int __map_script(struct script *script, int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) return -1;
+
+	script->size = st.st_size;
+	script->pos = 0;
+	script->data = NULL;
+	if (script->size == 0) return 0;
+
+	script->data = mmap(NULL, script->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (script->data == MAP_FAILED) return -1;
+	madvise(script->data, script->size, MADV_SEQUENTIAL);
+
+	return 0;
+}
+
+/**
+ * Copy the next line into @*command like getline() does, growing @*command
+ * (of *@size bytes) to fit the whole line.
+ */
+static char *__next_line(struct script *script, char **command, size_t *size)
+{
+	size_t len = script->size - script->pos;
+	char *start = script->data + script->pos;
+	char *newline;
+
+	if (len == 0) return NULL;
+
+	newline = memchr(start, '\n', len);
+	if (newline) len = newline - start + 1;
+
+	if (len + 1 > *size) {
+		size_t grown = *size ? *size : MAX_COMMAND_LEN;
+		char *buf;
+
+		while (grown < len + 1) grown *= 2;
+		buf = realloc(*command, grown);
+		if (!buf) return NULL;
+		*command = buf;
+		*size = grown;
+	}
+	memcpy(*command, start, len);
+	(*command)[len] = '\0';
+	script->pos += len;
+
+	return *command;
+}
+
+/**
+ * Make children see stdin positioned right after the current line, as if
+ * the shell had read it byte by byte. If a child consumed part of the script
+ * from the shared stdin, continue after what it consumed.
+ */
+static void __sync_script_before(struct script *script)
+{
+	if (script->fd < 0) return;
+	lseek(script->fd, script->pos, SEEK_SET);
+}
+
+static void __sync_script_after(struct script *script)
+{
+	off_t offset;
+
+	if (script->fd < 0) return;
+	offset = lseek(script->fd, 0, SEEK_CUR);
+	if (offset > 0 && (size_t)offset > script->pos) {
+		script->pos = (size_t)offset < script->size ? (size_t)offset : script->size;
+	}
+}
+
+static unsigned long long __now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
 /***********************************************************************
  * main() of this program.
  */
 int main(int argc, char * const argv[])
 {
-	char command[MAX_COMMAND_LEN] = { '\0' };
+	char *command = NULL;		/* Grows to the longest line */
+	size_t command_size = 0;
+	char **tokens = NULL;		/* Grows to the most tokens in a line */
+	int max_tokens = 0;
+	struct script script = { .fd = -1 };
+	char *batch = NULL;
+	char *server = NULL;
+	bool mapped = false;
 	int ret = 0;
 	int opt;
 
-	while ((opt = getopt(argc, argv, "qm")) != -1) {
+	while ((opt = getopt(argc, argv, "qmb:T:o:S:")) != -1) {
 		switch (opt) {
 		case 'q':
 			__verbose = false;
@@ -55,7 +166,59 @@ int main(int argc, char * const argv[])
 		case 'm':
 			__color_start = __color_end = "\0";
 			break;
+		case 'b':
+			batch = optarg;
+			__verbose = false;
+			break;
+		case 'S':
+			server = optarg;
+			break;
+		case 'T':
+			if (open_trace(optarg) < 0) {
+				fprintf(stderr, "Unable to open %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			__trace = true;
+			break;
+		case 'o': {
+			/* -o name=value, same as "set name value" */
+			char *value = strchr(optarg, '=');
+
+			if (value) *value++ = '\0';
+			if (set_option(optarg, value) < 0) {
+				fprintf(stderr, "Invalid option %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
 		}
+		}
+	}
+
+	if (server) {
+		/* Serve command lines from clients instead of reading stdin */
+		if (initialize(argc, argv)) return EXIT_FAILURE;
+		if (run_server(server) < 0) {
+			fprintf(stderr, "Unable to serve on %s\n", server);
+			ret = EXIT_FAILURE;
+		}
+		finalize(argc, argv);
+		return ret;
+	}
+
+	if (batch) {
+		/* The script is not inherited; children keep the shell's stdin */
+		int fd = open(batch, O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0 || __map_script(&script, fd) < 0) {
+			fprintf(stderr, "Unable to read %s\n", batch);
+			return EXIT_FAILURE;
+		}
+		close(fd);
+		mapped = true;
+	} else if (__map_script(&script, STDIN_FILENO) == 0) {
+		/* Redirected from a file. Map it, and keep the offset in sync */
+		script.fd = STDIN_FILENO;
+		mapped = true;
 	}
 
 	if ((ret = initialize(argc, argv))) return EXIT_FAILURE;
@@ -67,27 +230,43 @@ int main(int argc, char * const argv[])
 	setvbuf(stdin, NULL, _IONBF, 0);
 
 	while (true) {
-		char *tokens[MAX_NR_TOKENS] = { NULL };
+		unsigned long long read_ns = 0;
 		int nr_tokens = 0;
 
+		notify_jobs();
 		__print_prompt();
 	
-		if (!fgets(command, sizeof(command), stdin)) break;
+		if (mapped) {
+			if (!__next_line(&script, &command, &command_size)) break;
+		} else {
+			if (getline(&command, &command_size, stdin) < 0) break;
+		}
 
-		nr_tokens = parse_command(command, tokens);
+		/* Tokens are slices of @command, so nothing to free afterwards */
+		if (__trace) read_ns = __now_ns();
+		nr_tokens = tokenize_command_alloc(command, &tokens, &max_tokens);
+		if (nr_tokens < 0) {
+			fprintf(stderr, "Too many tokens\n");
+			continue;
+		}
 		if (nr_tokens == 0) continue;
+		if (__trace) trace_parse(read_ns, __now_ns());
 
+		__sync_script_before(&script);
 		ret = run_command(nr_tokens, tokens);
+		__sync_script_after(&script);
 		if (ret < 0) {
 			fprintf(stderr, "Unable to execute %s\n", tokens[0]);
 		}
 
-		free_command_tokens(tokens);
-
 		if (ret == 0 || ret == -EINVAL) break;
 	}
 
 	finalize(argc, argv);
 
+	free(command);
+	free(tokens);
+	if (mapped && script.data) munmap(script.data, script.size);
+
 	return EXIT_SUCCESS;
 }
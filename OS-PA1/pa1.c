@@ -18,238 +18,4344 @@ typedef unsigned char bool;
 #define false	0
 
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <spawn.h>
+#include <dirent.h>
+#include <fnmatch.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sched.h>
 #include "list_head.h"
 #include "parser.h"
+#include "arena.h"
 
 #define CHILD 0
+// 명령 한 줄을 처리하는 동안만 쓰는 메모리, run_command()가 끝나면 한꺼번에 비움
+static struct arena line_arena = ARENA_INIT;
 // alias 구현을 위한 구조체 선언, name은 사용자가 지정한 변수명, command는 대응되는 명령어
 typedef struct alias {
 	struct list_head list;
+	struct hlist_node hash; // 이름으로 바로 찾기 위한 해시 버킷 연결
 	char *name;
 	char *command;
+	int nr_tokens; // command를 미리 잘라둔 토큰, 치환할 땐 포인터만 끼워 넣음
+	char **tokens;
+	size_t size; // alias_pool에서 차지하는 크기
 } alias_entry;
-//stack 자료구조로 alias 사용
-LIST_HEAD(stack);
+// alias 이름공간, 서버 모드(mash -S)에서는 연결마다 따로 가짐
+struct alias_namespace {
+	//stack 자료구조로 alias 사용 (정의한 순서 유지, 목록 출력용)
+	struct list_head stack;
+	//alias는 셸이 끝날 때까지 살아있으므로 줄 단위 arena와 따로 모아둠
+	struct arena pool;
+	//다시 정의되면서 버려진 alias가 pool에서 차지하는 크기
+	size_t garbage;
+	//alias 이름 -> alias_entry 해시 테이블, 버킷 수는 항상 2의 거듭제곱
+	struct hlist_head *table;
+	unsigned int buckets;
+	unsigned int nr;
+};
+#define ALIAS_INIT_BUCKETS 64
+static struct alias_namespace default_aliases = {
+	.stack = LIST_HEAD_INIT(default_aliases.stack),
+	.pool = ARENA_INIT,
+};
+// 지금 명령이 쓰는 이름공간
+static struct alias_namespace *aliases = &default_aliases;
+
+// FNV-1a 문자열 해시
+static unsigned int hash_string(const char *str)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*str) {
+		hash ^= (unsigned char)*str++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static alias_entry *find_alias(const char *name)
+{
+	alias_entry *pos;
+
+	if (!aliases->buckets) return NULL;
+	hlist_for_each_entry(pos, &aliases->table[hash_string(name) & (aliases->buckets - 1)], hash) {
+		if (strcmp(pos->name, name) == 0) return pos;
+	}
+	return NULL;
+}
+
+// 버킷 수를 @nr_buckets로 바꾸고 모든 alias를 다시 해싱
+// alias 개수가 버킷 수를 넘으면 두 배로 늘려서 체인 길이를 짧게 유지
+static int rehash_alias_table(unsigned int nr_buckets)
+{
+	struct hlist_head *table = malloc(sizeof(*table) * nr_buckets);
+	alias_entry *pos;
+
+	if (!table) return -1;
+	for (unsigned int i = 0; i < nr_buckets; i++) {
+		INIT_HLIST_HEAD(&table[i]);
+	}
+	// 정의 순서 리스트를 따라가면서 새 테이블로 다시 해싱
+	list_for_each_entry(pos, &aliases->stack, list) {
+		hlist_add_head(&pos->hash, &table[hash_string(pos->name) & (nr_buckets - 1)]);
+	}
+	free(aliases->table);
+	aliases->table = table;
+	aliases->buckets = nr_buckets;
+	return 0;
+}
+
+// @pool에 alias 하나를 만듦, name/command/tokens 모두 같은 pool에서 할당, 실패하면 NULL
+static alias_entry *make_alias(struct arena *pool, const char *name, const char *command,
+		int nr_tokens, char *tokens[])
+{
+	size_t used = pool->used;
+	alias_entry *alias = arena_alloc(pool, sizeof(*alias));
+
+	// pool이 바닥나면 NULL, 이미 잡은 부분은 pool을 비울 때 돌아감
+	if (!alias) return NULL;
+	alias->name = arena_strdup(pool, name);
+	alias->command = arena_strdup(pool, command);
+	alias->nr_tokens = nr_tokens;
+	alias->tokens = arena_alloc(pool, sizeof(char *) * (nr_tokens + 1));
+	if (!alias->name || !alias->command || !alias->tokens) return NULL;
+	for (int i = 0; i < nr_tokens; i++) {
+		alias->tokens[i] = arena_strdup(pool, tokens[i]);
+		if (!alias->tokens[i]) return NULL;
+	}
+	alias->tokens[nr_tokens] = NULL;
+	alias->size = pool->used - used;
+	return alias;
+}
+
+// 버려진 alias가 pool의 절반을 넘으면 살아있는 alias만 새 pool로 옮겨서 메모리를 되돌려줌
+static void compact_alias_pool(void)
+{
+	struct arena pool = ARENA_INIT;
+	LIST_HEAD(live);
+	alias_entry *pos;
+
+	if (aliases->garbage < ARENA_MIN_CHUNK || aliases->garbage < aliases->pool.used / 2) return;
+
+	list_for_each_entry(pos, &aliases->stack, list) {
+		alias_entry *copy = make_alias(&pool, pos->name, pos->command, pos->nr_tokens, pos->tokens);
+
+		// 옮기지 못하면 지금 pool을 그대로 씀
+		if (!copy) {
+			arena_destroy(&pool);
+			return;
+		}
+		list_add_tail(&copy->list, &live);
+	}
+	arena_destroy(&aliases->pool);
+	aliases->pool = pool;
+	aliases->garbage = 0;
+
+	INIT_LIST_HEAD(&aliases->stack);
+	list_splice(&live, &aliases->stack);
+	rehash_alias_table(aliases->buckets);
+}
+
+/***********************************************************************
+ * new_alias_namespace(), free_alias_namespace(), use_alias_namespace()
+ *
+ * DESCRIPTION
+ *   Create and destroy an empty alias namespace, and make @ns the one that
+ *   the alias builtin and alias expansion use. The shell starts with its
+ *   own namespace; server.c gives every connection a separate one.
+ *   use_alias_namespace(NULL) switches back to the shell's namespace.
+ *
+ * RETURN VALUE
+ *   new_alias_namespace() returns NULL when out of memory.
+ *   use_alias_namespace() returns the namespace that was in use.
+ */
+struct alias_namespace *new_alias_namespace(void)
+{
+	struct alias_namespace *ns = calloc(1, sizeof(*ns));
+
+	if (!ns) return NULL;
+	INIT_LIST_HEAD(&ns->stack);
+	return ns;
+}
+
+void free_alias_namespace(struct alias_namespace *ns)
+{
+	if (ns == aliases) aliases = &default_aliases;
+	arena_destroy(&ns->pool);
+	free(ns->table);
+	if (ns != &default_aliases) free(ns);
+}
+
+struct alias_namespace *use_alias_namespace(struct alias_namespace *ns)
+{
+	struct alias_namespace *old = aliases;
+
+	aliases = ns ? ns : &default_aliases;
+	return old;
+}
+
+/***********************************************************************
+ * expand_aliases()
+ *
+ * DESCRIPTION
+ *   Replace every token in @tokens[] that names an alias with the
+ *   pre-tokenized expansion of the alias. Words coming from an expansion
+ *   are not expanded again. The expanded vector only holds pointers to
+ *   the original tokens and to the alias tokens, so nothing is copied.
+ *   @*expanded is set to @tokens when no alias is used. Otherwise it is
+ *   a NULL-terminated vector allocated from the line arena.
+ *
+ * RETURN VALUE
+ *   Return the number of tokens in @*expanded
+ *   Return <0 on error
+ */
+static int expand_aliases(int nr_tokens, char *tokens[], char ***expanded)
+{
+	alias_entry **hits;
+	int nr_expanded = 0;
+	bool found = false;
+	char **vec;
+
+	*expanded = tokens;
+	if (!aliases->nr) return nr_tokens;
+
+	hits = arena_alloc(&line_arena, sizeof(*hits) * nr_tokens);
+	if (!hits) return -1;
+	// 토큰마다 한 번씩만 찾아두고 치환 후의 길이를 계산
+	for (int i = 0; i < nr_tokens; i++) {
+		hits[i] = find_alias(tokens[i]);
+		if (hits[i]) {
+			nr_expanded += hits[i]->nr_tokens;
+			found = true;
+		} else {
+			nr_expanded++;
+		}
+	}
+	if (!found) return nr_tokens;
+
+	vec = arena_alloc(&line_arena, sizeof(char *) * (nr_expanded + 1));
+	if (!vec) return -1;
+	nr_expanded = 0;
+	for (int i = 0; i < nr_tokens; i++) {
+		if (hits[i]) {
+			memcpy(vec + nr_expanded, hits[i]->tokens, sizeof(char *) * hits[i]->nr_tokens);
+			nr_expanded += hits[i]->nr_tokens;
+		} else {
+			vec[nr_expanded++] = tokens[i];
+		}
+	}
+	// execvp 실행을 위해 마지막은 NULL
+	vec[nr_expanded] = NULL;
+	*expanded = vec;
+	return nr_expanded;
+}
+
+// 셸 변수, export한 것은 자식의 환경 변수가 됨
+typedef struct variable {
+	struct hlist_node hash;
+	char *entry;		// "NAME=value", 그대로 envp에 들어감
+	size_t name_len;	// 값은 entry + name_len + 1
+	bool exported;
+} variable;
+#define VARIABLE_BUCKETS 256
+// 변수 이름공간, 서버 모드(mash -S)에서는 연결마다 따로 가짐
+struct variable_namespace {
+	struct hlist_head table[VARIABLE_BUCKETS];
+	unsigned int nr_exported;
+	// exec에 넘기는 환경, export한 변수가 바뀔 때만 다시 만듦
+	char **envp_cache;
+	bool envp_dirty;
+};
+static struct variable_namespace default_variables = { .envp_dirty = true };
+// 지금 명령이 쓰는 이름공간
+static struct variable_namespace *variables = &default_variables;
+// 환경이 바뀔 때마다 늘어남, zygote가 옛 환경을 들고 있는지 확인할 때 씀
+static unsigned long env_generation = 0;
+static pid_t shell_pid;	// $$
+
+static bool is_name_start(char c)
+{
+	return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// @name에서 변수 이름이 끝나는 위치, 이름으로 시작하지 않으면 @name
+static const char *name_end(const char *name)
+{
+	if (!is_name_start(*name)) return name;
+	do {
+		name++;
+	} while (is_name_start(*name) || (*name >= '0' && *name <= '9'));
+	return name;
+}
+
+// hash_string()과 같은 해시, $NAME 처럼 '\0'으로 끝나지 않는 이름에 씀
+static unsigned int hash_bytes(const char *str, size_t len)
+{
+	unsigned int hash = 2166136261u;
+
+	while (len--) {
+		hash ^= (unsigned char)*str++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static variable *find_variable(const char *name, size_t len)
+{
+	variable *pos;
+
+	hlist_for_each_entry(pos, &variables->table[hash_bytes(name, len) & (VARIABLE_BUCKETS - 1)], hash) {
+		if (pos->name_len == len && memcmp(pos->entry, name, len) == 0) return pos;
+	}
+	return NULL;
+}
+
+// 이름이 @name부터 @len 바이트인 변수의 값, 없으면 NULL
+static const char *get_variable_n(const char *name, size_t len)
+{
+	variable *var = find_variable(name, len);
+
+	return var ? var->entry + var->name_len + 1 : NULL;
+}
+
+static const char *get_variable(const char *name)
+{
+	return get_variable_n(name, strlen(name));
+}
+
+static void env_changed(void)
+{
+	variables->envp_dirty = true;
+	env_generation++;
+}
+
+/***********************************************************************
+ * set_variable()
+ *
+ * DESCRIPTION
+ *   Set the variable @name to @value, or keep its value (empty if new)
+ *   when @value is NULL. The variable is exported if @export is true; an
+ *   exported variable stays exported. The cached envp is invalidated only
+ *   if an exported variable changes.
+ *
+ * RETURN VALUE
+ *   Return 0 on success, or -1 if memory cannot be allocated
+ */
+static int set_variable(const char *name, const char *value, bool export)
+{
+	size_t name_len = strlen(name);
+	variable *var = find_variable(name, name_len);
+	char *entry;
+
+	if (!value) value = var ? var->entry + var->name_len + 1 : "";
+	entry = malloc(name_len + strlen(value) + 2);
+	if (!entry) return -1;
+	strcpy(stpcpy(stpcpy(entry, name), "="), value);
+
+	if (!var) {
+		var = malloc(sizeof(*var));
+		if (!var) {
+			free(entry);
+			return -1;
+		}
+		*var = (variable) { .entry = NULL, .name_len = name_len, .exported = false };
+		hlist_add_head(&var->hash, &variables->table[hash_bytes(name, name_len) & (VARIABLE_BUCKETS - 1)]);
+	}
+	if (export && !var->exported) {
+		var->exported = true;
+		variables->nr_exported++;
+	}
+	if (var->exported) env_changed();
+	free(var->entry);
+	var->entry = entry;
+	return 0;
+}
+
+static void unset_variable(const char *name)
+{
+	variable *var = find_variable(name, strlen(name));
+
+	if (!var) return;
+	if (var->exported) {
+		variables->nr_exported--;
+		env_changed();
+	}
+	hlist_del(&var->hash);
+	free(var->entry);
+	free(var);
+}
+
+// envp_cache를 필요할 때만 다시 만듦, 항목은 변수의 entry를 그대로 가리킴
+static char **build_envp(void)
+{
+	char **envp;
+	int nr = 0;
+
+	if (!variables->envp_dirty) return variables->envp_cache;
+	envp = realloc(variables->envp_cache, sizeof(char *) * (variables->nr_exported + 1));
+	if (!envp) return variables->envp_cache;
+	for (int i = 0; i < VARIABLE_BUCKETS; i++) {
+		variable *pos;
+
+		hlist_for_each_entry(pos, &variables->table[i], hash) {
+			if (pos->exported) envp[nr++] = pos->entry;
+		}
+	}
+	envp[nr] = NULL;
+	variables->envp_cache = envp;
+	variables->envp_dirty = false;
+	return envp;
+}
+
+// 셸이 시작할 때 환경 변수를 모두 export한 셸 변수로 가져옴
+static void import_environ(void)
+{
+	for (char **env = environ; *env; env++) {
+		char *eq = strchr(*env, '=');
+		char *name;
+
+		if (!eq) continue;
+		name = strndup(*env, eq - *env);
+		if (name) set_variable(name, eq + 1, true);
+		free(name);
+	}
+}
+
+/***********************************************************************
+ * new_variable_namespace(), free_variable_namespace(),
+ * use_variable_namespace()
+ *
+ * DESCRIPTION
+ *   Create a variable namespace holding a copy of the shell's variables,
+ *   destroy one, and make @ns the one that expansion, assignments, export
+ *   and unset use and whose exported variables children get. server.c
+ *   gives every connection a separate one, like its alias namespace.
+ *   use_variable_namespace(NULL) switches back to the shell's namespace.
+ *
+ * RETURN VALUE
+ *   new_variable_namespace() returns NULL when out of memory.
+ *   use_variable_namespace() returns the namespace that was in use.
+ */
+void free_variable_namespace(struct variable_namespace *ns)
+{
+	if (ns == variables) variables = &default_variables;
+	for (int i = 0; i < VARIABLE_BUCKETS; i++) {
+		variable *pos;
+		struct hlist_node *tmp;
+
+		hlist_for_each_entry_safe(pos, tmp, &ns->table[i], hash) {
+			hlist_del(&pos->hash);
+			free(pos->entry);
+			free(pos);
+		}
+	}
+	free(ns->envp_cache);
+	if (ns != &default_variables) free(ns);
+}
+
+struct variable_namespace *new_variable_namespace(void)
+{
+	struct variable_namespace *ns = calloc(1, sizeof(*ns));
+
+	if (!ns) return NULL;
+	ns->envp_dirty = true;
+	for (int i = 0; i < VARIABLE_BUCKETS; i++) {
+		variable *pos;
+
+		hlist_for_each_entry(pos, &default_variables.table[i], hash) {
+			variable *copy = malloc(sizeof(*copy));
+
+			if (!copy || !(copy->entry = strdup(pos->entry))) {
+				free(copy);
+				free_variable_namespace(ns);
+				return NULL;
+			}
+			copy->name_len = pos->name_len;
+			copy->exported = pos->exported;
+			hlist_add_head(&copy->hash, &ns->table[i]);
+			if (copy->exported) ns->nr_exported++;
+		}
+	}
+	return ns;
+}
+
+struct variable_namespace *use_variable_namespace(struct variable_namespace *ns)
+{
+	struct variable_namespace *old = variables;
+
+	variables = ns ? ns : &default_variables;
+	return old;
+}
+
+// export 내장 명령, 인자가 없으면 export한 변수를 모두 출력
+static int builtin_export(int nr_tokens, char *tokens[])
+{
+	int ret = 1;
+
+	if (nr_tokens == 1) {
+		for (char **env = build_envp(); *env; env++) {
+			printf("export %s\n", *env);
+		}
+		return 1;
+	}
+	for (int i = 1; i < nr_tokens; i++) {
+		char *end = (char *)name_end(tokens[i]);
+
+		if (end == tokens[i] || (*end && *end != '=')) {
+			fprintf(stderr, "export: %s: not a valid identifier\n", tokens[i]);
+			ret = -1;
+			continue;
+		}
+		if (*end == '=') {
+			*end = '\0';
+			if (set_variable(tokens[i], end + 1, true) < 0) ret = -1;
+			*end = '=';
+		} else if (set_variable(tokens[i], NULL, true) < 0) {
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+// unset 내장 명령
+static int builtin_unset(int nr_tokens, char *tokens[])
+{
+	for (int i = 1; i < nr_tokens; i++) {
+		unset_variable(tokens[i]);
+	}
+	return 1;
+}
+
+// 명령어 이름 -> 실행 파일 절대 경로 캐시, 매번 execvp가 PATH를 뒤지는 걸 막음
+typedef struct path_entry {
+	struct hlist_node hash;
+	char *name;
+	char *path;
+	unsigned int hits;
+} path_entry;
+#define PATH_CACHE_BUCKETS 256
+static struct hlist_head path_cache[PATH_CACHE_BUCKETS];
+static unsigned int nr_cached_paths = 0;
+// 캐시를 채울 때의 PATH, 달라지면 캐시 전체를 버림
+static char *path_cache_env = NULL;
+
+static void flush_path_cache(void)
+{
+	path_entry *pos;
+	struct hlist_node *tmp;
+
+	for (int i = 0; i < PATH_CACHE_BUCKETS; i++) {
+		hlist_for_each_entry_safe(pos, tmp, &path_cache[i], hash) {
+			hlist_del(&pos->hash);
+			free(pos->name);
+			free(pos->path);
+			free(pos);
+		}
+	}
+	nr_cached_paths = 0;
+	free(path_cache_env);
+	path_cache_env = NULL;
+}
+
+// PATH의 디렉토리를 순서대로 보면서 실행 가능한 일반 파일을 찾음 (execvp와 같은 순서)
+static char *search_path(const char *name, const char *env)
+{
+	size_t name_len = strlen(name);
+	const char *dir = env;
+
+	while (dir) {
+		const char *end = strchr(dir, ':');
+		size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+		char *candidate = malloc(dir_len + name_len + 3);
+		struct stat st;
+
+		if (!candidate) return NULL;
+		// 빈 항목은 현재 디렉토리를 뜻함
+		if (dir_len == 0) strcpy(candidate, ".");
+		else {
+			memcpy(candidate, dir, dir_len);
+			candidate[dir_len] = '\0';
+		}
+		strcat(candidate, "/");
+		strcat(candidate, name);
+		if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0) {
+			return candidate;
+		}
+		free(candidate);
+		dir = end ? end + 1 : NULL;
+	}
+	return NULL;
+}
+
+/***********************************************************************
+ * lookup_command()
+ *
+ * DESCRIPTION
+ *   Resolve @name to the path of the executable to run, consulting the
+ *   path cache first. The cache is flushed when $PATH has changed since
+ *   it was filled, and an entry is dropped when its file is no longer
+ *   executable. Names containing '/' and paths found through a relative
+ *   $PATH entry are not cached.
+ *
+ * RETURN VALUE
+ *   Return the path to pass to execv(). It is valid until the next call.
+ *   Return NULL if @name cannot be found in $PATH
+ */
+static const char *lookup_command(const char *name)
+{
+	static char *uncached = NULL;
+	const char *env = get_variable("PATH");
+	unsigned int bucket = hash_string(name) & (PATH_CACHE_BUCKETS - 1);
+	path_entry *pos;
+	char *path;
+
+	if (strchr(name, '/')) return name;
+	if (!env) env = "/bin:/usr/bin";
+
+	if (path_cache_env && strcmp(path_cache_env, env) != 0) flush_path_cache();
+	hlist_for_each_entry(pos, &path_cache[bucket], hash) {
+		if (strcmp(pos->name, name) != 0) continue;
+		// 캐시된 파일이 사라졌으면 버리고 다시 찾음
+		if (access(pos->path, X_OK) == 0) {
+			pos->hits++;
+			return pos->path;
+		}
+		hlist_del(&pos->hash);
+		free(pos->name);
+		free(pos->path);
+		free(pos);
+		nr_cached_paths--;
+		break;
+	}
+
+	free(uncached);
+	uncached = NULL;
+	path = search_path(name, env);
+	if (!path) return NULL;
+	if (path[0] != '/') return uncached = path;
+
+	// 캐시에 넣지 못해도 찾은 경로는 이번 한 번 쓸 수 있음
+	pos = malloc(sizeof(*pos));
+	if (!pos || !(pos->name = strdup(name))) {
+		free(pos);
+		return uncached = path;
+	}
+	pos->path = path;
+	pos->hits = 1;
+	hlist_add_head(&pos->hash, &path_cache[bucket]);
+	nr_cached_paths++;
+	if (!path_cache_env) path_cache_env = strdup(env);
+	return path;
+}
+
+static int count_tokens(char *argv[])
+{
+	int argc = 0;
+
+	while (argv[argc]) argc++;
+	return argc;
+}
+
+// execvp처럼 #! 없는 스크립트(ENOEXEC)는 /bin/sh @path @argv[1]... 로 실행하도록 @sh_argv를 채움
+// @sh_argv는 @argv보다 하나 더 커야 함
+static void script_argv(char *sh_argv[], char *argv[], const char *path)
+{
+	int i = 1;
+
+	sh_argv[0] = "/bin/sh";
+	sh_argv[1] = (char *)path;
+	do {
+		sh_argv[i + 1] = argv[i];
+	} while (argv[i++]);
+}
+
+// 자식이 exec할 때의 signal mask, 셸이 시작할 때의 것
+// parallel 등은 SIGCHLD를 막은 채로 자식을 띄우므로 그대로 물려주면 자식의 wait가 망가짐
+static sigset_t child_sigmask;
+
+// 자식에서 호출, 환경은 fork 전에 build_envp()로 만들어 둔 것을 그대로 넘김
+// @path가 NULL이면 셸의 $PATH에 없는 명령, execvp는 셸 프로세스의 옛 PATH를 뒤지므로 쓰지 않음
+static void exec_command(char *argv[], const char *path)
+{
+	if (!path) return;
+	sigprocmask(SIG_SETMASK, &child_sigmask, NULL);
+	execve(path, argv, variables->envp_cache);
+	if (errno != ENOEXEC) return;
+	char *sh_argv[count_tokens(argv) + 2];
+
+	script_argv(sh_argv, argv, path);
+	execve(sh_argv[0], sh_argv, variables->envp_cache);
+}
+
+// hash 내장 명령: 인자가 없으면 캐시 목록, -r이면 비우기, 이름이 있으면 찾아서 캐시에 넣음
+static int builtin_hash(int nr_tokens, char *tokens[])
+{
+	path_entry *pos;
+	int ret = 1;
+
+	if (nr_tokens == 1) {
+		if (!nr_cached_paths) return 1;
+		fprintf(stderr, "hits\tcommand\n");
+		for (int i = 0; i < PATH_CACHE_BUCKETS; i++) {
+			hlist_for_each_entry(pos, &path_cache[i], hash) {
+				fprintf(stderr, "%4u\t%s\n", pos->hits, pos->path);
+			}
+		}
+		return 1;
+	}
+	for (int i = 1; i < nr_tokens; i++) {
+		if (strcmp(tokens[i], "-r") == 0) {
+			flush_path_cache();
+		} else if (!lookup_command(tokens[i])) {
+			fprintf(stderr, "hash: %s: not found\n", tokens[i]);
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+// 자식 프로세스를 만드는 방법, set spawn 으로 실행 중에 바꿀 수 있음
+enum spawn_mode {
+	SPAWN_FORK,	// fork() 후 자식에서 dup2, exec
+	SPAWN_POSIX,	// posix_spawn(), glibc는 clone(CLONE_VM|CLONE_VFORK)로 페이지 테이블을 복사하지 않음
+	SPAWN_ZYGOTE,	// 미리 fork해 둔 작은 도우미 프로세스가 대신 만들어 줌
+	NR_SPAWN_MODES,
+};
+static const char *spawn_mode_names[NR_SPAWN_MODES] = {
+	"fork",
+	"posix_spawn",
+	"zygote",
+};
+static enum spawn_mode spawn_mode = SPAWN_FORK;
+
+// 방법별 spawn 지연 시간 (부모가 다시 진행할 수 있을 때까지) 통계
+struct spawn_stat {
+	unsigned long nr_spawns;
+	unsigned long long total_ns;
+	unsigned long long min_ns;
+	unsigned long long max_ns;
+};
+static struct spawn_stat spawn_stats[NR_SPAWN_MODES];
+
+static unsigned long long elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000000ULL + end->tv_nsec - start->tv_nsec;
+}
+
+static void account_spawn(enum spawn_mode mode, const struct timespec *start)
+{
+	struct spawn_stat *stat = &spawn_stats[mode];
+	struct timespec end;
+	unsigned long long ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns = elapsed_ns(start, &end);
+	if (!stat->nr_spawns || ns < stat->min_ns) stat->min_ns = ns;
+	if (ns > stat->max_ns) stat->max_ns = ns;
+	stat->total_ns += ns;
+	stat->nr_spawns++;
+}
+
+// 파이프라인이 쓴 자원, wait4로 받은 자식의 rusage와 셸 안에서 돈 내장 명령의 getrusage 차이를 합침
+struct usage {
+	unsigned long long utime_us;
+	unsigned long long stime_us;
+	long maxrss_kb;	// 단계 중 가장 큰 값
+	long nvcsw;	// 자발적 문맥 교환 (I/O 등을 기다림)
+	long nivcsw;	// 비자발적 문맥 교환 (타임 슬라이스를 다 씀)
+	long majflt;
+	long minflt;
+};
+// 마지막으로 실행한 파이프라인의 자원 사용량, run_pipeline()이 채움
+static struct usage pipeline_usage;
+// 세션 전체에서 포그라운드로 실행한 파이프라인의 합계, timestat 으로 출력
+static unsigned long nr_timed_pipelines;
+static unsigned long long session_real_ns;
+static struct usage session_usage;
+
+static unsigned long long timeval_us(const struct timeval *tv)
+{
+	return tv->tv_sec * 1000000ULL + tv->tv_usec;
+}
+
+// @usage에 @after - @before를 더함, 자식의 rusage처럼 차이가 아니면 @before는 NULL
+static void add_rusage(struct usage *usage, const struct rusage *after, const struct rusage *before)
+{
+	static const struct rusage zero;
+
+	if (!before) before = &zero;
+	usage->utime_us += timeval_us(&after->ru_utime) - timeval_us(&before->ru_utime);
+	usage->stime_us += timeval_us(&after->ru_stime) - timeval_us(&before->ru_stime);
+	if (after->ru_maxrss > usage->maxrss_kb) usage->maxrss_kb = after->ru_maxrss;
+	usage->nvcsw += after->ru_nvcsw - before->ru_nvcsw;
+	usage->nivcsw += after->ru_nivcsw - before->ru_nivcsw;
+	usage->majflt += after->ru_majflt - before->ru_majflt;
+	usage->minflt += after->ru_minflt - before->ru_minflt;
+}
+
+static void add_usage(struct usage *sum, const struct usage *usage)
+{
+	sum->utime_us += usage->utime_us;
+	sum->stime_us += usage->stime_us;
+	if (usage->maxrss_kb > sum->maxrss_kb) sum->maxrss_kb = usage->maxrss_kb;
+	sum->nvcsw += usage->nvcsw;
+	sum->nivcsw += usage->nivcsw;
+	sum->majflt += usage->majflt;
+	sum->minflt += usage->minflt;
+}
+
+static void print_usage(unsigned long long real_ns, const struct usage *usage)
+{
+	fprintf(stderr, "real\t%.3fs\n", real_ns / 1e9);
+	fprintf(stderr, "user\t%.3fs\n", usage->utime_us / 1e6);
+	fprintf(stderr, "sys\t%.3fs\n", usage->stime_us / 1e6);
+	fprintf(stderr, "maxrss\t%ld KB\n", usage->maxrss_kb);
+	fprintf(stderr, "ctxsw\t%ld voluntary, %ld involuntary\n", usage->nvcsw, usage->nivcsw);
+	fprintf(stderr, "faults\t%ld major, %ld minor\n", usage->majflt, usage->minflt);
+}
+
+// mash -T 로 켜는 실행 추적, 명령 한 줄마다 JSON 한 줄을 씀 (시각은 CLOCK_MONOTONIC ns, 모르면 null)
+#define MAX_TRACE_PROCS 64
+struct trace_proc {
+	pid_t pid;
+	const char *name;		// argv[0], run_command()가 끝날 때까지 유효
+	unsigned long long fork_ns;	// fork (posix_spawn) 직전
+	unsigned long long forked_ns;	// 부모에서 fork (posix_spawn)가 돌아온 시각
+	unsigned long long exec_ns;	// 자식이 exec 하기 직전
+	unsigned long long reap_ns;	// wait4가 이 자식을 회수한 시각
+	int exec_fd;			// 자식이 exec_ns를 써 주는 파이프, 다 읽었으면 -1
+};
+static struct {
+	FILE *file;			// NULL이면 추적하지 않음
+	unsigned long nr_lines;
+	unsigned long long read_ns;	// 한 줄을 읽어서 자르기 시작한 시각
+	unsigned long long parsed_ns;
+	unsigned long long run_ns;	// run_command()에 들어온 시각
+	unsigned long long expanded_ns;	// 첫 명령의 alias 치환이 끝난 시각
+	unsigned long long wait_ns;	// 이 줄에서 wait4가 처음 돌아온 시각
+	int nr_procs;
+	unsigned int nr_dropped;	// procs[]가 꽉 차서 기록하지 못한 자식 수
+	struct trace_proc procs[MAX_TRACE_PROCS];
+} trace;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/***********************************************************************
+ * open_trace()
+ *
+ * DESCRIPTION
+ *   Start writing a trace line for every command line to @path, or to
+ *   stderr if @path is "-". Called by mash.c for the -T option.
+ *
+ * RETURN VALUE
+ *   Return 0 on success, or -1 if @path cannot be opened
+ */
+int open_trace(const char *path)
+{
+	trace.file = strcmp(path, "-") == 0 ? stderr : fopen(path, "we");
+	return trace.file ? 0 : -1;
+}
+
+// mash.c가 한 줄을 읽고 토큰으로 자른 시각을 넘겨줌
+void trace_parse(unsigned long long read_ns, unsigned long long parsed_ns)
+{
+	trace.read_ns = read_ns;
+	trace.parsed_ns = parsed_ns;
+}
+
+// 자식에서 exec 직전 시각을 보낼 파이프를 만듦, 부모는 회수한 뒤에 읽으므로 기다리지 않음
+static int trace_exec_pipe(int fd[2])
+{
+	fd[0] = fd[1] = -1;
+	if (!trace.file || trace.nr_procs == MAX_TRACE_PROCS) return 0;
+	return pipe2(fd, O_CLOEXEC | O_NONBLOCK);
+}
+
+static void trace_spawn(pid_t pid, const char *name, const struct timespec *start, int exec_fd)
+{
+	if (!trace.file) return;
+	if (trace.nr_procs == MAX_TRACE_PROCS) {
+		trace.nr_dropped++;
+		if (exec_fd >= 0) close(exec_fd);
+		return;
+	}
+	trace.procs[trace.nr_procs++] = (struct trace_proc) {
+		.pid = pid,
+		.name = name,
+		.fork_ns = start->tv_sec * 1000000000ULL + start->tv_nsec,
+		.forked_ns = now_ns(),
+		.exec_fd = exec_fd,
+	};
+}
+
+// exec 하지 않았거나 (내장 명령, exec 실패) 아직 exec 전이면 읽을 게 없어서 exec_ns는 0으로 남음
+static void trace_read_exec(struct trace_proc *proc)
+{
+	if (proc->exec_fd < 0) return;
+	if (read(proc->exec_fd, &proc->exec_ns, sizeof(proc->exec_ns)) != sizeof(proc->exec_ns)) {
+		proc->exec_ns = 0;
+	}
+	close(proc->exec_fd);
+	proc->exec_fd = -1;
+}
+
+static void trace_reap(pid_t pid)
+{
+	unsigned long long ns;
+
+	if (!trace.file) return;
+	ns = now_ns();
+	if (!trace.wait_ns) trace.wait_ns = ns;
+	for (int i = 0; i < trace.nr_procs; i++) {
+		struct trace_proc *proc = &trace.procs[i];
+
+		if (proc->pid != pid || proc->reap_ns) continue;
+		proc->reap_ns = ns;
+		trace_read_exec(proc);
+		return;
+	}
+}
+
+static void trace_string(const char *str)
+{
+	fputc('"', trace.file);
+	for (; *str; str++) {
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\') fprintf(trace.file, "\\%c", c);
+		else if (c < 0x20) fprintf(trace.file, "\\u%04x", c);
+		else fputc(c, trace.file);
+	}
+	fputc('"', trace.file);
+}
+
+static void trace_ns(const char *key, unsigned long long ns)
+{
+	if (ns) fprintf(trace.file, ",\"%s\":%llu", key, ns);
+	else fprintf(trace.file, ",\"%s\":null", key);
+}
+
+// 한 줄의 추적을 쓰고 다음 줄을 위해 비움, 백그라운드 작업은 회수 시각 없이 나감
+static void trace_emit(const char *command, int ret, int status)
+{
+	fprintf(trace.file, "{\"line\":%lu,\"command\":", ++trace.nr_lines);
+	trace_string(command);
+	trace_ns("read", trace.read_ns);
+	trace_ns("parsed", trace.parsed_ns);
+	trace_ns("run", trace.run_ns);
+	trace_ns("expanded", trace.expanded_ns);
+	trace_ns("first_wait", trace.wait_ns);
+	trace_ns("done", now_ns());
+	fprintf(trace.file, ",\"ret\":%d,\"status\":%d,\"procs\":[", ret, status);
+	for (int i = 0; i < trace.nr_procs; i++) {
+		struct trace_proc *proc = &trace.procs[i];
+
+		trace_read_exec(proc);
+		fprintf(trace.file, "%s{\"pid\":%d,\"argv0\":", i ? "," : "", proc->pid);
+		trace_string(proc->name);
+		trace_ns("fork", proc->fork_ns);
+		trace_ns("forked", proc->forked_ns);
+		trace_ns("exec", proc->exec_ns);
+		trace_ns("reap", proc->reap_ns);
+		fputc('}', trace.file);
+	}
+	fprintf(trace.file, "],\"dropped\":%u}\n", trace.nr_dropped);
+
+	trace.read_ns = trace.parsed_ns = trace.expanded_ns = trace.wait_ns = 0;
+	trace.nr_procs = 0;
+	trace.nr_dropped = 0;
+}
+
+// 파이프라인 한 단계의 리다이렉션 (< file, > file, >> file, 2> file, 2>> file, 2>&1)
+struct redirect {
+	const char *path[3];	// stdin, stdout, stderr 별 파일, 없으면 NULL
+	bool append[3];
+	bool err_to_out;	// 2>&1, stdout을 바꾼 뒤에 stderr로 복사
+};
+
+// 긴 것부터 맞춰봐야 >>가 >로 잘리지 않음
+static const struct {
+	const char *op;
+	int fd;
+	bool append;
+} redirect_ops[] = {
+	{ "2>>", STDERR_FILENO, true },
+	{ "2>", STDERR_FILENO, false },
+	{ ">>", STDOUT_FILENO, true },
+	{ ">", STDOUT_FILENO, false },
+	{ "<", STDIN_FILENO, false },
+};
+#define NR_REDIRECT_OPS (sizeof(redirect_ops) / sizeof(redirect_ops[0]))
+
+// 대량 출력용 옵션 (set odirect, set prealloc), stdout 리다이렉션에만 적용
+// O_DIRECT는 정렬된 버퍼로 쓰는 셸 자신의 복사(copy_fd())에만 쓰고, 외부 명령에는 넘기지 않음
+static bool redirect_direct = false;
+static unsigned long long redirect_prealloc = 0;
+// 지금 실행 중인 내장 명령의 stdout이 set odirect on에서 연 리다이렉션 파일
+static bool stdout_direct = false;
+
+/***********************************************************************
+ * parse_redirects()
+ *
+ * DESCRIPTION
+ *   Move the redirections in the NULL-terminated @argv[] into @redirect
+ *   and pack the remaining arguments in place. The file name may be the
+ *   next token ("> out") or follow the operator ("2>err").
+ *
+ * RETURN VALUE
+ *   Return 0 on success, or -1 if an operator has no file name
+ */
+static int parse_redirects(char *argv[], struct redirect *redirect)
+{
+	int nr = 0;
+
+	memset(redirect, 0, sizeof(*redirect));
+	for (int i = 0; argv[i]; i++) {
+		unsigned int op;
+
+		if (strcmp(argv[i], "2>&1") == 0) {
+			redirect->err_to_out = true;
+			continue;
+		}
+		for (op = 0; op < NR_REDIRECT_OPS; op++) {
+			if (strncmp(argv[i], redirect_ops[op].op, strlen(redirect_ops[op].op)) == 0) break;
+		}
+		if (op == NR_REDIRECT_OPS) {
+			argv[nr++] = argv[i];
+			continue;
+		}
+		int fd = redirect_ops[op].fd;
+		char *path = argv[i] + strlen(redirect_ops[op].op);
+
+		if (!*path) path = argv[++i];
+		if (!path) return -1;
+		redirect->path[fd] = path;
+		redirect->append[fd] = redirect_ops[op].append;
+		// 2>&1 뒤에 2>가 오면 나중 것이 이김
+		if (fd == STDERR_FILENO) redirect->err_to_out = false;
+	}
+	argv[nr] = NULL;
+	return 0;
+}
+
+/***********************************************************************
+ * open_redirects()
+ *
+ * DESCRIPTION
+ *   Open the files of @redirect into @fds[] (-1 for no file), close-on-exec.
+ *   Blocks of output files for stdout are preallocated beyond the current
+ *   end under "set prealloc", without changing the file size. O_DIRECT is
+ *   never set here: ordinary writers do not use aligned buffers, so it is
+ *   left to copy_fd() under "set odirect on".
+ *
+ * RETURN VALUE
+ *   Return 0 on success
+ *   Return -1 after reporting the file that cannot be opened
+ */
+static int open_redirects(const struct redirect *redirect, int fds[3])
+{
+	for (int fd = 0; fd < 3; fd++) {
+		const char *path = redirect->path[fd];
+		int flags = O_CLOEXEC;
+
+		fds[fd] = -1;
+		if (!path) continue;
+		if (fd == STDIN_FILENO) {
+			flags |= O_RDONLY;
+		} else {
+			flags |= O_WRONLY | O_CREAT | (redirect->append[fd] ? O_APPEND : O_TRUNC);
+		}
+		fds[fd] = open(path, flags, 0666);
+		if (fds[fd] < 0) {
+			fprintf(stderr, "mash: %s: %s\n", path, strerror(errno));
+			for (int i = 0; i < fd; i++) {
+				if (fds[i] >= 0) close(fds[i]);
+			}
+			return -1;
+		}
+		// 파일 시스템이 지원하지 않으면 그냥 넘어감
+		if (fd == STDOUT_FILENO && redirect_prealloc) {
+			off_t offset = redirect->append[fd] ? lseek(fds[fd], 0, SEEK_END) : 0;
+
+			fallocate(fds[fd], FALLOC_FL_KEEP_SIZE, offset, redirect_prealloc);
+		}
+	}
+	return 0;
+}
+
+// 자식에서 호출, exec 전에 리다이렉션을 적용함
+static int apply_redirects(const struct redirect *redirect)
+{
+	int fds[3];
+
+	if (open_redirects(redirect, fds) < 0) return -1;
+	for (int fd = 0; fd < 3; fd++) {
+		if (fds[fd] < 0) continue;
+		dup2(fds[fd], fd);
+		close(fds[fd]);
+	}
+	if (redirect->err_to_out) dup2(STDOUT_FILENO, STDERR_FILENO);
+	return 0;
+}
+
+/**
+ * zygote: a helper forked while the shell is still small. It receives
+ * spawn requests over a socketpair and creates the children with
+ * clone(CLONE_PARENT), so they are children of the shell as in the other
+ * modes (waitpid(), SIGCHLD and jobs work unchanged), while the address
+ * space of the shell is never duplicated.
+ *
+ * A request is a struct zygote_request followed by the path to execute
+ * ("" to search PATH) and the arguments, all NUL-terminated, with stdin,
+ * stdout, stderr and the current directory attached as SCM_RIGHTS. The
+ * zygote answers with the pid of the child or -errno.
+ */
+#define ZYGOTE_MAX_REQUEST	(64 << 10)
+#define ZYGOTE_NR_FDS		4	// stdin, stdout, stderr, 현재 디렉토리
+#define ZYGOTE_UNAVAILABLE	-2	// zygote가 없거나 요청이 너무 큼, 직접 fork함
+
+struct zygote_request {
+	unsigned int argc;
+	unsigned int size;	// 뒤따르는 문자열의 크기
+	bool report;		// exec 실패를 stderr에 출력
+};
+
+static pid_t zygote_pid = -1;
+static int zygote_sock = -1;
+static pid_t zygote_owner = -1;	// zygote를 띄운 셸, zygote의 자식은 이 프로세스의 자식이 됨
+static unsigned long zygote_env_generation;	// zygote가 물려받은 환경의 env_generation
+
+static void zygote_main(int sock)
+{
+	static char buf[sizeof(struct zygote_request) + ZYGOTE_MAX_REQUEST];
+
+	while (true) {
+		char control[CMSG_SPACE(sizeof(int) * ZYGOTE_NR_FDS)];
+		struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+		struct msghdr msg = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+		struct zygote_request *req = (struct zygote_request *)buf;
+		struct cmsghdr *cmsg;
+		int fds[ZYGOTE_NR_FDS];
+		char *p = buf + sizeof(*req);
+		ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+		long ret;
+
+		if (n < 0 && errno == EINTR) continue;
+		// 셸이 끝나서 소켓이 닫힘
+		if (n <= 0) _exit(EXIT_SUCCESS);
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+				cmsg->cmsg_len != CMSG_LEN(sizeof(fds)) || (size_t)n < sizeof(*req)) {
+			ret = -EINVAL;
+			send(sock, &ret, sizeof(ret), 0);
+			continue;
+		}
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+		char *path = p;
+		char *argv[req->argc + 1];
+
+		p += strlen(p) + 1;
+		for (unsigned int i = 0; i < req->argc; i++) {
+			argv[i] = p;
+			p += strlen(p) + 1;
+		}
+		argv[req->argc] = NULL;
+
+		// fork처럼 스택을 복사해서 이어서 실행, 부모는 zygote가 아니라 셸이 됨
+		ret = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+		if (ret == CHILD) {
+			for (int fd = 0; fd < 3; fd++) {
+				dup2(fds[fd], fd);
+			}
+			if (fchdir(fds[3]) < 0) _exit(1);
+			exec_command(argv, *path ? path : NULL);
+			if (req->report) fprintf(stderr, "Unable to execute %s\n", argv[0]);
+			_exit(1);
+		}
+		if (ret < 0) ret = -errno;
+		send(sock, &ret, sizeof(ret), 0);
+		for (int i = 0; i < ZYGOTE_NR_FDS; i++) {
+			close(fds[i]);
+		}
+	}
+}
+
+static int start_zygote(void)
+{
+	int sv[2];
+
+	if (zygote_pid > 0) return 0;
+	build_envp();
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) return -1;
+	zygote_pid = fork();
+	if (zygote_pid == CHILD) {
+		close(sv[0]);
+		signal(SIGCHLD, SIG_DFL);
+		zygote_main(sv[1]);
+	}
+	close(sv[1]);
+	if (zygote_pid < 0) {
+		close(sv[0]);
+		return -1;
+	}
+	zygote_sock = sv[0];
+	zygote_owner = getpid();
+	zygote_env_generation = env_generation;
+	return 0;
+}
+
+static void stop_zygote(void)
+{
+	if (zygote_pid <= 0) return;
+	close(zygote_sock);
+	waitpid(zygote_pid, NULL, 0);
+	zygote_pid = -1;
+	zygote_sock = -1;
+}
+
+/***********************************************************************
+ * refresh_zygote()
+ *
+ * DESCRIPTION
+ *   Replace the zygote if export, unset or an assignment has changed the
+ *   environment since it was started. This must be called between lines:
+ *   the new zygote is forked from the shell and would keep any pipe that
+ *   is open at that time.
+ */
+static void refresh_zygote(void)
+{
+	if (zygote_pid <= 0 || zygote_owner != getpid() || zygote_env_generation == env_generation) {
+		return;
+	}
+	stop_zygote();
+	start_zygote();
+}
+
+/***********************************************************************
+ * zygote_spawn()
+ *
+ * DESCRIPTION
+ *   Ask the zygote to start @argv[] (at @path if not NULL) with @fds[] as
+ *   its stdin, stdout and stderr, in the current directory of the shell.
+ *
+ * RETURN VALUE
+ *   Return the pid of the child
+ *   Return ZYGOTE_UNAVAILABLE if the zygote cannot take the request, or if
+ *   the caller is not the shell that started it (e.g., a builtin running in
+ *   a forked pipeline stage), which could not wait for the child; the
+ *   zygote is stopped if it died so that the next request starts a new one.
+ *   A zygote started before the last change of the environment is not used
+ *   until refresh_zygote() replaces it
+ *   Return -1 if the child could not be started
+ */
+static pid_t zygote_spawn(char *argv[], const char *path, int fds[3], bool report)
+{
+	struct zygote_request req = { .argc = 0, .size = 0, .report = report };
+	char control[CMSG_SPACE(sizeof(int) * ZYGOTE_NR_FDS)] = { 0 };
+	struct iovec iov[2];
+	struct msghdr msg = {
+		.msg_iov = iov,
+		.msg_iovlen = 2,
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	int sent[ZYGOTE_NR_FDS] = { fds[0], fds[1], fds[2], -1 };
+	char *strings, *p;
+	long pid;
+
+	// 셸에서 fork된 프로세스가 요청하면 자식을 기다릴 수 없으므로 직접 fork하게 함
+	if (zygote_pid > 0 && zygote_owner != getpid()) return ZYGOTE_UNAVAILABLE;
+	// 옛 환경을 들고 있는 zygote는 다음 줄을 시작할 때 새로 띄우고, 그때까지는 직접 fork하게 함
+	if (zygote_pid > 0 && zygote_env_generation != env_generation) return ZYGOTE_UNAVAILABLE;
+	if (zygote_pid <= 0 && start_zygote() < 0) return ZYGOTE_UNAVAILABLE;
+
+	req.size = strlen(path ? path : "") + 1;
+	for (; argv[req.argc]; req.argc++) {
+		req.size += strlen(argv[req.argc]) + 1;
+	}
+	if (req.size > ZYGOTE_MAX_REQUEST) return ZYGOTE_UNAVAILABLE;
+	strings = p = arena_alloc(&line_arena, req.size);
+	if (!strings) return ZYGOTE_UNAVAILABLE;
+	p = stpcpy(p, path ? path : "") + 1;
+	for (unsigned int i = 0; i < req.argc; i++) {
+		p = stpcpy(p, argv[i]) + 1;
+	}
+
+	// cd로 바뀌었을 수 있으므로 요청마다 현재 디렉토리를 넘김
+	sent[3] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (sent[3] < 0) return ZYGOTE_UNAVAILABLE;
+
+	iov[0] = (struct iovec) { .iov_base = &req, .iov_len = sizeof(req) };
+	iov[1] = (struct iovec) { .iov_base = strings, .iov_len = req.size };
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(sent));
+	memcpy(CMSG_DATA(cmsg), sent, sizeof(sent));
+
+	if (sendmsg(zygote_sock, &msg, MSG_NOSIGNAL) < 0 ||
+			recv(zygote_sock, &pid, sizeof(pid), 0) != sizeof(pid)) {
+		close(sent[3]);
+		stop_zygote();
+		return ZYGOTE_UNAVAILABLE;
+	}
+	close(sent[3]);
+	if (pid < 0) {
+		if (report) fprintf(stderr, "Unable to execute %s\n", argv[0]);
+		return -1;
+	}
+	return pid;
+}
+
+/***********************************************************************
+ * spawn_command()
+ *
+ * DESCRIPTION
+ *   Start @argv[] in a child process whose stdin and stdout are @in_fd and
+ *   @out_fd, using the current spawn mode. @redirect is applied on top of
+ *   them in the child. Descriptors that the child must not inherit (e.g.,
+ *   other pipe ends) should be close-on-exec. When
+ *   @report is true, a failure to execute is reported on stderr; otherwise
+ *   it is left to the exit status of the child (or the return value).
+ *
+ * RETURN VALUE
+ *   Return the pid of the child
+ *   Return -1 if the child could not be started
+ */
+static pid_t spawn_command(char *argv[], int in_fd, int out_fd, const struct redirect *redirect,
+		bool report)
+{
+	// 경로 캐시는 부모에 남아야 하므로 fork 전에 찾음
+	const char *path = lookup_command(argv[0]);
+	// 자식은 fork 시점의 envp_cache를 물려받으므로 여기서 만들어 둠
+	char **envp = build_envp();
+	enum spawn_mode mode = spawn_mode;
+	struct timespec start;
+	pid_t pid;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (mode == SPAWN_ZYGOTE) {
+		int fds[3];
+
+		// zygote에는 리다이렉션까지 적용한 최종 fd만 넘김
+		if (open_redirects(redirect, fds) < 0) return -1;
+		int std[3] = {
+			fds[STDIN_FILENO] >= 0 ? fds[STDIN_FILENO] : in_fd,
+			fds[STDOUT_FILENO] >= 0 ? fds[STDOUT_FILENO] : out_fd,
+			fds[STDERR_FILENO] >= 0 ? fds[STDERR_FILENO] : STDERR_FILENO,
+		};
+		if (redirect->err_to_out) std[STDERR_FILENO] = std[STDOUT_FILENO];
+		pid = zygote_spawn(argv, path, std, report);
+		for (int fd = 0; fd < 3; fd++) {
+			if (fds[fd] >= 0) close(fds[fd]);
+		}
+		// zygote를 쓸 수 없으면 이번에는 직접 fork
+		if (pid == ZYGOTE_UNAVAILABLE) mode = SPAWN_FORK;
+		else if (pid < 0) return -1;
+		// zygote의 자식이 exec하는 시각은 받지 않음
+		else trace_spawn(pid, argv[0], &start, -1);
+	}
+	if (mode == SPAWN_POSIX) {
+		posix_spawn_file_actions_t actions;
+		posix_spawnattr_t attr;
+		int fds[3];
+		int err;
+
+		// fallocate는 file action으로 할 수 없으므로 리다이렉션 파일은 부모에서 열어서 넘김
+		if (open_redirects(redirect, fds) < 0) return -1;
+		// fork 모드에서 자식이 하던 dup2를 file action으로 넘김
+		posix_spawn_file_actions_init(&actions);
+		if (in_fd != STDIN_FILENO) posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+		if (out_fd != STDOUT_FILENO) posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+		for (int fd = 0; fd < 3; fd++) {
+			if (fds[fd] >= 0) posix_spawn_file_actions_adddup2(&actions, fds[fd], fd);
+		}
+		if (redirect->err_to_out) posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+		posix_spawnattr_init(&attr);
+		posix_spawnattr_setsigmask(&attr, &child_sigmask);
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+		err = path ? posix_spawn(&pid, path, &actions, &attr, argv, envp) : ENOENT;
+		if (err == ENOEXEC) {
+			char **sh_argv = arena_alloc(&line_arena, sizeof(char *) * (count_tokens(argv) + 2));
+
+			if (sh_argv) {
+				script_argv(sh_argv, argv, path);
+				err = posix_spawn(&pid, sh_argv[0], &actions, &attr, sh_argv, envp);
+			}
+		}
+		posix_spawnattr_destroy(&attr);
+		posix_spawn_file_actions_destroy(&actions);
+		for (int fd = 0; fd < 3; fd++) {
+			if (fds[fd] >= 0) close(fds[fd]);
+		}
+		// posix_spawn은 exec 실패도 부모에서 바로 알 수 있음
+		if (err) {
+			if (report) fprintf(stderr, "Unable to execute %s\n", argv[0]);
+			return -1;
+		}
+		// posix_spawn은 자식에서 코드를 돌릴 수 없으므로 exec 시각은 남기지 않음
+		trace_spawn(pid, argv[0], &start, -1);
+	} else if (mode == SPAWN_FORK) {
+		int exec_fd[2];
+
+		if (trace_exec_pipe(exec_fd) < 0) exec_fd[0] = exec_fd[1] = -1;
+		pid = fork();
+		if (pid == CHILD) {
+			if (in_fd != STDIN_FILENO) dup2(in_fd, STDIN_FILENO);
+			if (out_fd != STDOUT_FILENO) dup2(out_fd, STDOUT_FILENO);
+			if (apply_redirects(redirect) < 0) _exit(1);
+			if (exec_fd[1] >= 0) {
+				unsigned long long ns = now_ns();
+
+				if (write(exec_fd[1], &ns, sizeof(ns)) != sizeof(ns)) close(exec_fd[1]);
+			}
+			exec_command(argv, path);
+			if (report) fprintf(stderr, "Unable to execute %s\n", argv[0]);
+			// 부모의 stdio 버퍼가 두 번 나가지 않도록 flush 없이 종료
+			_exit(1);
+		}
+		if (exec_fd[1] >= 0) close(exec_fd[1]);
+		if (pid == -1) {
+			if (exec_fd[0] >= 0) close(exec_fd[0]);
+			return -1;
+		}
+		trace_spawn(pid, argv[0], &start, exec_fd[0]);
+	}
+	account_spawn(mode, &start);
+	return pid;
+}
+
+// 백그라운드 작업 (& 로 실행한 파이프라인), 작업 번호는 슬롯 번호 + 1
+#define MAX_NR_JOBS 256
+struct job {
+	int nr_pids;	// 0이면 빈 슬롯
+	int nr_alive;	// 아직 회수하지 않은 프로세스 수, 0이 되면 끝난 작업
+	pid_t *pids;	// 단계별 pid, 회수한 건 0으로 바꿈
+	int status;	// 마지막 단계의 종료 상태
+	char *command;
+};
+// SIGCHLD 핸들러도 건드리므로 핸들러 밖에서는 SIGCHLD를 막고 수정해야 함
+static struct job jobs[MAX_NR_JOBS];
+static int last_job = -1; // 가장 최근에 만든 작업, fg의 기본 대상
+
+// 백그라운드 작업의 프로세스만 WNOHANG으로 회수함, 포그라운드 자식은 각자 waitpid로 기다림
+static void reap_jobs(void)
+{
+	for (int i = 0; i < MAX_NR_JOBS; i++) {
+		struct job *job = &jobs[i];
+
+		if (!job->nr_alive) continue;
+		for (int j = 0; j < job->nr_pids; j++) {
+			int status;
+
+			if (job->pids[j] <= 0) continue;
+			if (waitpid(job->pids[j], &status, WNOHANG) != job->pids[j]) continue;
+			job->pids[j] = 0;
+			job->nr_alive--;
+			if (j == job->nr_pids - 1) job->status = status;
+		}
+	}
+}
+
+static void sigchld_handler(int signal)
+{
+	int saved_errno = errno;
+
+	reap_jobs();
+	errno = saved_errno;
+}
+
+static void block_sigchld(sigset_t *old)
+{
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, old);
+}
+
+// SIGCHLD를 막은 상태에서 호출
+static void free_job(struct job *job)
+{
+	free(job->pids);
+	free(job->command);
+	job->pids = NULL;
+	job->command = NULL;
+	job->nr_pids = 0;
+}
+
+/***********************************************************************
+ * add_job()
+ *
+ * DESCRIPTION
+ *   Register @nr_pids processes in @pids[] running the pipeline @stages[]
+ *   as a background job. The processes are reaped by the SIGCHLD handler.
+ *
+ * RETURN VALUE
+ *   Return the job id
+ *   Return -1 if the job table is full or out of memory
+ */
+static int add_job(pid_t pids[], int nr_pids, int nr_stages, char **stages[])
+{
+	struct job *job = NULL;
+	size_t len = 0;
+	sigset_t old;
+	int id;
+
+	for (int i = 0; i < nr_stages; i++) {
+		for (char **arg = stages[i]; *arg; arg++) len += strlen(*arg) + 3;
+	}
+
+	block_sigchld(&old);
+	for (id = 0; id < MAX_NR_JOBS; id++) {
+		if (!jobs[id].nr_pids) {
+			job = &jobs[id];
+			break;
+		}
+	}
+	if (job) {
+		job->pids = malloc(sizeof(pid_t) * nr_pids);
+		// jobs에서 보여줄 명령어, 단계 사이는 " | "로 이어 붙임
+		job->command = malloc(len + 1);
+		if (!job->pids || !job->command) {
+			free(job->pids);
+			free(job->command);
+			job->pids = NULL;
+			job->command = NULL;
+			job = NULL;
+		}
+	}
+	if (!job) {
+		sigprocmask(SIG_SETMASK, &old, NULL);
+		return -1;
+	}
+	memcpy(job->pids, pids, sizeof(pid_t) * nr_pids);
+	job->nr_pids = job->nr_alive = nr_pids;
+	job->status = 0;
+	job->command[0] = '\0';
+	for (int i = 0; i < nr_stages; i++) {
+		if (i) strcat(job->command, " | ");
+		for (char **arg = stages[i]; *arg; arg++) {
+			if (arg != stages[i]) strcat(job->command, " ");
+			strcat(job->command, *arg);
+		}
+	}
+	last_job = id;
+	// 등록하기 전에 이미 끝난 프로세스는 SIGCHLD가 지나갔으므로 한 번 직접 회수함
+	reap_jobs();
+	sigprocmask(SIG_SETMASK, &old, NULL);
+
+	return id + 1;
+}
+
+// SIGCHLD를 막은 상태에서 호출, 작업이 끝날 때까지 기다린 후 슬롯을 비우고 종료 상태를 돌려줌
+static int wait_job(struct job *job, const sigset_t *old)
+{
+	int status;
+
+	while (job->nr_alive) sigsuspend(old);
+	status = job->status;
+	free_job(job);
+	return status;
+}
+
+static void print_job(int id, const char *state)
+{
+	fprintf(stderr, "[%d] %s\t%s\n", id + 1, state, jobs[id].command);
+}
+
+/***********************************************************************
+ * notify_jobs()
+ *
+ * DESCRIPTION
+ *   Report the background jobs that have finished since the last call and
+ *   release their slots. Called before printing the prompt.
+ */
+void notify_jobs(void)
+{
+	sigset_t old;
+
+	block_sigchld(&old);
+	for (int i = 0; i < MAX_NR_JOBS; i++) {
+		if (!jobs[i].nr_pids || jobs[i].nr_alive) continue;
+		print_job(i, WIFEXITED(jobs[i].status) && WEXITSTATUS(jobs[i].status) == 0 ? "Done" : "Exit");
+		free_job(&jobs[i]);
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+// "%3", "3" 모두 작업 번호로 받음
+static struct job *find_job(const char *arg)
+{
+	int id;
+
+	if (*arg == '%') arg++;
+	id = atoi(arg) - 1;
+	if (id < 0 || id >= MAX_NR_JOBS || !jobs[id].nr_pids) {
+		fprintf(stderr, "mash: no such job %s\n", arg);
+		return NULL;
+	}
+	return &jobs[id];
+}
+
+// jobs 내장 명령: 실행 중이거나 끝났지만 아직 알리지 않은 작업 목록
+static int builtin_jobs(int nr_tokens, char *tokens[])
+{
+	sigset_t old;
+
+	block_sigchld(&old);
+	for (int i = 0; i < MAX_NR_JOBS; i++) {
+		if (!jobs[i].nr_pids) continue;
+		print_job(i, jobs[i].nr_alive ? "Running" : "Done");
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	return 1;
+}
+
+// wait 내장 명령: 인자가 없으면 모든 작업, 있으면 그 작업들이 끝날 때까지 기다림
+static int builtin_wait(int nr_tokens, char *tokens[])
+{
+	sigset_t old;
+	int ret = 1;
+
+	block_sigchld(&old);
+	if (nr_tokens == 1) {
+		for (int i = 0; i < MAX_NR_JOBS; i++) {
+			if (jobs[i].nr_pids) wait_job(&jobs[i], &old);
+		}
+	}
+	for (int i = 1; i < nr_tokens; i++) {
+		struct job *job = find_job(tokens[i]);
+
+		if (!job) {
+			ret = -1;
+			continue;
+		}
+		if (wait_job(job, &old) != 0) ret = -1;
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	return ret;
+}
+
+// fg 내장 명령: 작업 하나를 포그라운드로 가져와서 끝날 때까지 기다림, 기본은 가장 최근 작업
+static int builtin_fg(int nr_tokens, char *tokens[])
+{
+	struct job *job;
+	sigset_t old;
+	int status;
+
+	block_sigchld(&old);
+	if (nr_tokens > 1) {
+		job = find_job(tokens[1]);
+	} else {
+		// 가장 최근 작업이 이미 끝났으면 남은 작업 중 번호가 가장 큰 것
+		job = NULL;
+		if (last_job >= 0 && jobs[last_job].nr_pids) job = &jobs[last_job];
+		for (int i = MAX_NR_JOBS - 1; !job && i >= 0; i--) {
+			if (jobs[i].nr_pids) job = &jobs[i];
+		}
+		if (!job) fprintf(stderr, "mash: no current job\n");
+	}
+	if (!job) {
+		sigprocmask(SIG_SETMASK, &old, NULL);
+		return -1;
+	}
+	fprintf(stderr, "%s\n", job->command);
+	status = wait_job(job, &old);
+	sigprocmask(SIG_SETMASK, &old, NULL);
+
+	return status == 0 ? 1 : -1;
+}
+
+// set 내장 명령으로 바꿀 수 있는 셸 옵션
+struct shell_option {
+	const char *name;
+	int (*set)(const char *value);
+	const char *(*show)(void);
+};
+
+// mash -o는 initialize() 전에 처리되므로 그때는 zygote를 미뤄 둠
+static bool initialized = false;
+
+static int set_spawn_mode(const char *value)
+{
+	for (int i = 0; i < NR_SPAWN_MODES; i++) {
+		if (strcmp(value, spawn_mode_names[i]) == 0) {
+			// zygote는 셸이 작을 때 만들어 두는 게 좋으므로 고르자마자 fork
+			if (i == SPAWN_ZYGOTE && initialized && start_zygote() < 0) return -1;
+			if (i != SPAWN_ZYGOTE) stop_zygote();
+			spawn_mode = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static const char *show_spawn_mode(void)
+{
+	return spawn_mode_names[spawn_mode];
+}
+
+// 파이프라인의 파이프 버퍼 크기, 0이면 커널 기본값 (64 KiB)
+static int pipe_size = 0;
+
+// 크기는 바이트 단위, k, m, g를 붙일 수 있음
+static int parse_size(const char *value, unsigned long long *size)
+{
+	char *end;
+
+	*size = strtoull(value, &end, 10);
+	if (*end == 'k' || *end == 'K') *size <<= 10, end++;
+	else if (*end == 'm' || *end == 'M') *size <<= 20, end++;
+	else if (*end == 'g' || *end == 'G') *size <<= 30, end++;
+	if (end == value || *end || *size == 0) return -1;
+	return 0;
+}
+
+// 커널이 올림한 실제 크기를 저장
+static int set_pipe_size(const char *value)
+{
+	unsigned long long size;
+	int fd[2];
+
+	if (strcmp(value, "default") == 0) {
+		pipe_size = 0;
+		return 0;
+	}
+	if (parse_size(value, &size) < 0 || size > INT_MAX) return -1;
+
+	// pipe-max-size를 넘는지 등은 실제로 파이프를 만들어 봐야 알 수 있음
+	if (pipe2(fd, O_CLOEXEC) < 0) return -1;
+	pipe_size = fcntl(fd[STDOUT_FILENO], F_SETPIPE_SZ, (int)size);
+	close(fd[STDIN_FILENO]);
+	close(fd[STDOUT_FILENO]);
+	if (pipe_size < 0) {
+		pipe_size = 0;
+		return -1;
+	}
+	return 0;
+}
+
+static const char *show_pipe_size(void)
+{
+	static char buf[16];
+
+	if (!pipe_size) return "default";
+	snprintf(buf, sizeof(buf), "%d", pipe_size);
+	return buf;
+}
+
+static int set_redirect_direct(const char *value)
+{
+	if (strcmp(value, "on") == 0) redirect_direct = true;
+	else if (strcmp(value, "off") == 0) redirect_direct = false;
+	else return -1;
+	return 0;
+}
+
+static const char *show_redirect_direct(void)
+{
+	return redirect_direct ? "on" : "off";
+}
+
+static int set_redirect_prealloc(const char *value)
+{
+	unsigned long long size;
+
+	if (strcmp(value, "off") == 0) {
+		redirect_prealloc = 0;
+		return 0;
+	}
+	if (parse_size(value, &size) < 0) return -1;
+	redirect_prealloc = size;
+	return 0;
+}
+
+static const char *show_redirect_prealloc(void)
+{
+	static char buf[24];
+
+	if (!redirect_prealloc) return "off";
+	snprintf(buf, sizeof(buf), "%llu", redirect_prealloc);
+	return buf;
+}
+
+static struct shell_option shell_options[] = {
+	{ "spawn", set_spawn_mode, show_spawn_mode },
+	{ "pipesize", set_pipe_size, show_pipe_size },
+	{ "odirect", set_redirect_direct, show_redirect_direct },
+	{ "prealloc", set_redirect_prealloc, show_redirect_prealloc },
+};
+#define NR_SHELL_OPTIONS (sizeof(shell_options) / sizeof(shell_options[0]))
+
+/***********************************************************************
+ * set_option()
+ *
+ * DESCRIPTION
+ *   Set the shell option @name to @value, as "set @name @value" does. Also
+ *   called by mash.c for "-o @name=@value" before any command runs.
+ *
+ * RETURN VALUE
+ *   Return 0 on success
+ *   Return -ENOENT if there is no such option, -EINVAL if @value is invalid
+ */
+int set_option(const char *name, const char *value)
+{
+	for (unsigned int i = 0; i < NR_SHELL_OPTIONS; i++) {
+		if (strcmp(name, shell_options[i].name) != 0) continue;
+		if (!value || shell_options[i].set(value) < 0) return -EINVAL;
+		return 0;
+	}
+	return -ENOENT;
+}
+
+// set 내장 명령: 인자가 없으면 옵션 목록, set <옵션> <값>이면 옵션 변경
+static int builtin_set(int nr_tokens, char *tokens[])
+{
+	int err;
+
+	if (nr_tokens == 1) {
+		for (unsigned int i = 0; i < NR_SHELL_OPTIONS; i++) {
+			fprintf(stderr, "%s: %s\n", shell_options[i].name, shell_options[i].show());
+		}
+		return 1;
+	}
+	err = set_option(tokens[1], nr_tokens == 3 ? tokens[2] : NULL);
+	if (err == -ENOENT) {
+		fprintf(stderr, "set: unknown option %s\n", tokens[1]);
+		return -1;
+	}
+	if (err) {
+		fprintf(stderr, "set: invalid value for %s\n", tokens[1]);
+		return -1;
+	}
+	return 1;
+}
+
+// spawnstat 내장 명령: spawn 방법별 지연 시간 출력, -r이면 초기화
+static int builtin_spawnstat(int nr_tokens, char *tokens[])
+{
+	if (nr_tokens > 1 && strcmp(tokens[1], "-r") == 0) {
+		memset(spawn_stats, 0, sizeof(spawn_stats));
+		return 1;
+	}
+	fprintf(stderr, "%-12s %8s %10s %10s %10s\n", "mode", "spawns", "avg(us)", "min(us)", "max(us)");
+	for (int i = 0; i < NR_SPAWN_MODES; i++) {
+		struct spawn_stat *stat = &spawn_stats[i];
+		double avg = stat->nr_spawns ? (double)stat->total_ns / stat->nr_spawns : 0;
+
+		fprintf(stderr, "%-12s %8lu %10.1f %10.1f %10.1f\n", spawn_mode_names[i],
+				stat->nr_spawns, avg / 1000, stat->min_ns / 1000.0, stat->max_ns / 1000.0);
+	}
+	return 1;
+}
+
+// timestat 내장 명령: 세션에서 실행한 포그라운드 파이프라인의 자원 사용량 합계, -r이면 초기화
+static int builtin_timestat(int nr_tokens, char *tokens[])
+{
+	if (nr_tokens > 1 && strcmp(tokens[1], "-r") == 0) {
+		nr_timed_pipelines = 0;
+		session_real_ns = 0;
+		memset(&session_usage, 0, sizeof(session_usage));
+		return 1;
+	}
+	fprintf(stderr, "pipelines\t%lu\n", nr_timed_pipelines);
+	print_usage(session_real_ns, &session_usage);
+	return 1;
+}
+
+//alias 일 경우 내부 명령어기 때문에 fork 할 필요는 없음
+static int builtin_alias(int nr_tokens, char *tokens[])
+{
+	//alias 명령어를 추가하는 케이스도 생각해야 함 -> 이 때는 nr_tokens가 2개 이상임
+	if (nr_tokens > 1) {
+		//input size는 토큰 길이의 합 + 공백, 잠깐 쓰고 버리므로 줄 단위 arena에서 할당
+		size_t input_size = 1;
+		for (int i = 2; i < nr_tokens; i++) {
+			input_size += strlen(tokens[i]) + 1;
+		}
+		char *input_command = arena_alloc(&line_arena, input_size);
+		if (input_command == NULL) return -1;
+		input_command[0] = '\0';
+		// alias xyz hello world가 들어올 땐 xyz 뒤의 hello world 전체가 들어옴 따라서 이걸 전부 다 고려 (공백도 두번 스페이스 되더라도 한개로 처리)
+		for (int i = 2; i < nr_tokens; i++) {
+			strcat(input_command, tokens[i]);
+			// input command에 공백도 고려해서 넘겨줌
+			if (i < nr_tokens - 1) {
+				strcat(input_command, " ");
+			}	
+		}
+		//치환할 때마다 parse_command를 다시 하지 않도록 토큰을 미리 복사해둠
+		alias_entry *old_alias = find_alias(tokens[1]);
+		alias_entry *add_alias = make_alias(&aliases->pool, tokens[1], input_command, nr_tokens - 2, tokens + 2);
+		if (!add_alias) {
+			fprintf(stderr, "Unable to allocate alias\n");
+			return -1;
+		}
+		// 이미 있는 이름이면 그 자리를 새 alias로 바꿈 (목록 순서 유지)
+		if (old_alias) {
+			list_replace(&old_alias->list, &add_alias->list);
+			hlist_del(&old_alias->hash);
+			hlist_add_head(&add_alias->hash, &aliases->table[hash_string(add_alias->name) & (aliases->buckets - 1)]);
+			aliases->garbage += old_alias->size;
+			return 1;
+		}
+		//해시 테이블이 꽉 차면 늘리고 나서 추가
+		if (aliases->nr >= aliases->buckets &&
+				rehash_alias_table(aliases->buckets ? aliases->buckets * 2 : ALIAS_INIT_BUCKETS) < 0) {
+			return -1;
+		}
+		//pa0처럼 stack에다 추가
+		list_add(&add_alias->list, &aliases->stack);
+		hlist_add_head(&add_alias->hash, &aliases->table[hash_string(add_alias->name) & (aliases->buckets - 1)]);
+		aliases->nr++;
+	}
+	// alias 목록 리스트 출력할 케이스
+	else {
+		alias_entry *alias_list;
+		// alias에 저장된 명령어를 출력할 때 , readme에는 역순으로 출력함 따라서 reverse로 접근
+		list_for_each_entry_reverse(alias_list, &aliases->stack, list) {
+			fprintf(stderr, "%s: %s\n", alias_list->name, alias_list->command);
+		}
+	}
+	return 1;
+}
+
+// cd 내장 명령
+static int builtin_cd(int nr_tokens, char *tokens[])
+{
+	//디렉토리를 변경할 경우, 두번째 토큰에 path가 전달됨 따라서 dir 문자열에 token의 두번째 토큰값 전달
+	char *dir = tokens[1];
+	//cd나 cd ~ 일 경우 사용자의 홈디렉토리로 변경
+	if (tokens[1] == NULL || strcmp(tokens[1], "~") == 0) {
+		dir = (char *)get_variable("HOME");
+	}
+	//디렉토리 변경에 실패할 경우엔 -1 반환 아니면 1 반환
+	if (chdir(dir) != 0) {
+		return -1;
+	}
+	return 1;
+}
+
+static int builtin_exit(int nr_tokens, char *tokens[])
+{
+	return 0;
+}
+
+static int builtin_true(int nr_tokens, char *tokens[])
+{
+	return 1;
+}
+
+static int builtin_false(int nr_tokens, char *tokens[])
+{
+	return -1;
+}
+
+// 내장 명령이 stdout에 쓴 것을 내보내고 쓰기 오류를 확인, 실패하면 남은 버퍼는 버림
+static int flush_stdout(const char *name)
+{
+	if (fflush(stdout) == 0 && !ferror(stdout)) return 1;
+	fprintf(stderr, "%s: write error: %s\n", name, strerror(errno));
+	__fpurge(stdout);
+	clearerr(stdout);
+	return -1;
+}
+
+// echo 내장 명령, -n이면 줄바꿈을 하지 않음
+static int builtin_echo(int nr_tokens, char *tokens[])
+{
+	bool newline = true;
+	int i = 1;
+
+	if (nr_tokens > 1 && strcmp(tokens[1], "-n") == 0) {
+		newline = false;
+		i++;
+	}
+	for (; i < nr_tokens; i++) {
+		fputs(tokens[i], stdout);
+		if (i < nr_tokens - 1) putchar(' ');
+	}
+	if (newline) putchar('\n');
+	return flush_stdout("echo");
+}
+
+static int builtin_pwd(int nr_tokens, char *tokens[])
+{
+	char *cwd = getcwd(NULL, 0);
+
+	if (!cwd) return -1;
+	puts(cwd);
+	free(cwd);
+	return 1;
+}
+
+// \n, \t 같은 escape 하나를 출력하고 마지막으로 읽은 글자의 위치를 돌려줌
+static const char *put_escape(const char *p)
+{
+	static const char *from = "abefnrtv\\";
+	static const char *to = "\a\b\033\f\n\r\t\v\\";
+	const char *c;
+	int value = 0;
+
+	p++;
+	if (*p == '\0') {
+		putchar('\\');
+		return p - 1;
+	}
+	if ((c = strchr(from, *p))) {
+		putchar(to[c - from]);
+		return p;
+	}
+	// \0NNN 또는 \NNN 8진수
+	if (*p >= '0' && *p <= '7') {
+		if (*p == '0') p++;
+		for (int i = 0; i < 3 && *p >= '0' && *p <= '7'; i++, p++) {
+			value = value * 8 + (*p - '0');
+		}
+		putchar(value);
+		return p - 1;
+	}
+	putchar('\\');
+	putchar(*p);
+	return p;
+}
+
+/***********************************************************************
+ * builtin_printf()
+ *
+ * DESCRIPTION
+ *   printf FORMAT [ARGUMENT]...
+ *   Supports the escapes of put_escape() and the %s, %b, %c, %d, %i, %u,
+ *   %o, %x, %X, %e, %f, %g conversions with flags, width and precision.
+ *   As in POSIX printf, FORMAT is reused until all arguments are consumed.
+ */
+static int builtin_printf(int nr_tokens, char *tokens[])
+{
+	const char *format;
+	int arg = 2;
+
+	if (nr_tokens < 2) {
+		fprintf(stderr, "printf: usage: printf format [arguments]\n");
+		return -1;
+	}
+	format = tokens[1];
+	do {
+		int consumed = arg;
+
+		for (const char *p = format; *p; p++) {
+			char spec[32];
+			const char *value;
+			char conv;
+			size_t n;
+
+			if (*p == '\\') {
+				p = put_escape(p);
+				continue;
+			}
+			if (*p != '%') {
+				putchar(*p);
+				continue;
+			}
+			if (p[1] == '%') {
+				putchar('%');
+				p++;
+				continue;
+			}
+			// %[flags][width][.precision] 부분은 그대로 libc printf에 넘김
+			n = strspn(p + 1, "-+ #0123456789.");
+			conv = p[n + 1];
+			if (n > sizeof(spec) - 5 || !conv || !strchr("sbcdiuoxXefgEG", conv)) {
+				putchar(*p);
+				continue;
+			}
+			memcpy(spec, p, n + 1);
+			value = arg < nr_tokens ? tokens[arg++] : "";
+			switch (conv) {
+			case 's':
+				strcpy(spec + n + 1, "s");
+				printf(spec, value);
+				break;
+			case 'b':
+				for (const char *v = value; *v; v++) {
+					if (*v == '\\') v = put_escape(v);
+					else putchar(*v);
+				}
+				break;
+			case 'c':
+				strcpy(spec + n + 1, "c");
+				if (*value) printf(spec, *value);
+				break;
+			case 'd': case 'i':
+				sprintf(spec + n + 1, "ll%c", conv);
+				printf(spec, strtoll(value, NULL, 0));
+				break;
+			case 'u': case 'o': case 'x': case 'X':
+				sprintf(spec + n + 1, "ll%c", conv);
+				printf(spec, strtoull(value, NULL, 0));
+				break;
+			default:
+				sprintf(spec + n + 1, "%c", conv);
+				printf(spec, strtod(value, NULL));
+				break;
+			}
+			p += n + 1;
+		}
+		// 이번에 인자를 하나도 안 썼으면 형식을 반복하지 않음
+		if (arg == consumed) break;
+	} while (arg < nr_tokens);
+
+	return flush_stdout("printf");
+}
+
+// cat, tee가 한 번에 옮기는 양, 파이프 용량보다 크면 커널이 알아서 줄임
+#define SPLICE_CHUNK (1 << 20)
+static char copy_buf[64 << 10];
+
+static bool is_pipe(int fd)
+{
+	struct stat st;
+
+	return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+// splice, sendfile을 못 쓰는 경우 (터미널 등) 사용자 공간 버퍼로 복사, @len이 0이면 EOF까지
+static int copy_fd_slow(int in, int out, size_t len)
+{
+	bool all = len == 0;
+
+	while (all || len) {
+		size_t want = all || len > sizeof(copy_buf) ? sizeof(copy_buf) : len;
+		ssize_t n = read(in, copy_buf, want);
+
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) return -1;
+		if (n == 0) break;
+		if (write_all(out, copy_buf, n) < 0) return -1;
+		if (!all) len -= n;
+	}
+	return 0;
+}
+
+// O_DIRECT로 쓰는 버퍼의 정렬과 크기, 페이지 단위면 보통의 논리 블록 크기도 만족함
+#define DIRECT_ALIGN 4096
+#define DIRECT_CHUNK (1 << 20)
+
+/***********************************************************************
+ * copy_fd_direct()
+ *
+ * DESCRIPTION
+ *   Copy @in to the regular file @out until EOF, writing whole blocks from
+ *   a page-aligned buffer with O_DIRECT set on @out. The last partial
+ *   block is written after O_DIRECT is cleared again. If the file system
+ *   refuses O_DIRECT part way, the rest is written normally.
+ *
+ * RETURN VALUE
+ *   Return 0 on success, or -1 with errno set
+ *   Return 1 if nothing was copied because O_DIRECT cannot be used (not a
+ *   regular file, unaligned offset, or no buffer)
+ */
+static int copy_fd_direct(int in, int out)
+{
+	static char *buf = NULL;
+	int flags = fcntl(out, F_GETFL);
+	bool direct = true;
+	size_t len = 0;
+	struct stat st;
+	off_t offset;
+	int ret = 0;
+
+	if (!buf && posix_memalign((void **)&buf, DIRECT_ALIGN, DIRECT_CHUNK) != 0) buf = NULL;
+	// 파이프에 O_DIRECT를 켜면 패킷 모드가 되므로 일반 파일에만 씀
+	if (!buf || flags < 0 || fstat(out, &st) < 0 || !S_ISREG(st.st_mode)) return 1;
+	offset = lseek(out, 0, (flags & O_APPEND) ? SEEK_END : SEEK_CUR);
+	if (offset < 0 || offset % DIRECT_ALIGN || fcntl(out, F_SETFL, flags | O_DIRECT) < 0) return 1;
+
+	while (true) {
+		ssize_t n = read(in, buf + len, DIRECT_CHUNK - len);
+		size_t aligned;
+
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) {
+			ret = -1;
+			break;
+		}
+		if (n == 0) break;
+		len += n;
+		// 블록 단위로 찬 만큼만 쓰고 나머지는 다음에 읽은 것과 합침
+		aligned = len & ~(size_t)(DIRECT_ALIGN - 1);
+		for (size_t done = 0; done < aligned && ret == 0;) {
+			ssize_t w = write(out, buf + done, aligned - done);
+
+			if (w < 0 && errno == EINTR) continue;
+			if (w < 0 && errno == EINVAL && direct) {
+				direct = false;
+				fcntl(out, F_SETFL, flags);
+				continue;
+			}
+			if (w < 0) ret = -1;
+			else done += w;
+		}
+		if (ret < 0) break;
+		memmove(buf, buf + aligned, len - aligned);
+		len -= aligned;
+	}
+	// 블록이 안 되는 끝부분은 O_DIRECT 없이 씀
+	fcntl(out, F_SETFL, flags);
+	if (ret == 0 && len) ret = write_all(out, buf, len);
+	return ret;
+}
+
+/***********************************************************************
+ * copy_fd()
+ *
+ * DESCRIPTION
+ *   Copy @in to @out until EOF without bringing the data to user space
+ *   when possible: splice() if either end is a pipe, sendfile() between
+ *   other files. The kernel refuses both for some files (e.g., a tty), and
+ *   then the data is copied through a buffer. When @out is the stdout of
+ *   a builtin redirected under "set odirect on", copy_fd_direct() is tried
+ *   first.
+ *
+ * RETURN VALUE
+ *   Return 0 on success, or -1 with errno set
+ */
+static int copy_fd(int in, int out)
+{
+	bool spliced = is_pipe(in) || is_pipe(out);
+	bool moved = false;
+	ssize_t n;
+
+	if (out == STDOUT_FILENO && stdout_direct) {
+		int ret = copy_fd_direct(in, out);
+
+		if (ret <= 0) return ret;
+	}
+
+	while (true) {
+		if (spliced) n = splice(in, NULL, out, NULL, SPLICE_CHUNK, SPLICE_F_MOVE);
+		else n = sendfile(out, in, NULL, SPLICE_CHUNK);
+		if (n > 0) {
+			moved = true;
+			continue;
+		}
+		if (n == 0) return 0;
+		if (errno == EINTR) continue;
+		// 지원하지 않는 파일이면 처음부터 안 되므로 옮긴 것이 없을 때만 되돌아감
+		if (moved || (errno != EINVAL && errno != ENOSYS)) return -1;
+		return copy_fd_slow(in, out, 0);
+	}
+}
+
+// 파이프 @in에 있는 @len 바이트를 @out으로 옮김
+static int drain_pipe(int in, int out, size_t len)
+{
+	while (len) {
+		ssize_t n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE);
+
+		if (n < 0 && errno == EINTR) continue;
+		// O_APPEND 파일이나 터미널처럼 splice가 안 되는 곳은 읽어서 씀
+		if (n < 0 && errno == EINVAL) return copy_fd_slow(in, out, len);
+		if (n <= 0) return -1;
+		len -= n;
+	}
+	return 0;
+}
+
+/***********************************************************************
+ * tee_fds()
+ *
+ * DESCRIPTION
+ *   Copy @in to every @outs[] until EOF. When @in is a pipe, tee(2)
+ *   duplicates what is in it into a private pipe, one output at a time,
+ *   without consuming it; the last output moves the data out of @in. The
+ *   private pipe is then spliced to the output, so nothing is copied to
+ *   user space unless an output does not support splice().
+ *
+ * RETURN VALUE
+ *   Return 0 on success, or -1 with errno set
+ */
+static int tee_fds(int in, int outs[], int nr_outs)
+{
+	int priv[2];
+	int ret = 0;
+
+	if (!is_pipe(in) || pipe2(priv, O_CLOEXEC) < 0) {
+		while (ret == 0) {
+			ssize_t n = read(in, copy_buf, sizeof(copy_buf));
+
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return n;
+			for (int i = 0; i < nr_outs; i++) {
+				if (write_all(outs[i], copy_buf, n) < 0) ret = -1;
+			}
+		}
+		return ret;
+	}
+	fcntl(priv[STDOUT_FILENO], F_SETPIPE_SZ, SPLICE_CHUNK);
+
+	while (ret == 0) {
+		ssize_t len = 0;
+
+		for (int i = 0; i < nr_outs && ret == 0; i++) {
+			// 처음에 얼마나 옮길지 정하고, 나머지 출력에도 같은 @len 바이트를 보냄
+			size_t want = i == 0 ? SPLICE_CHUNK : (size_t)len;
+			ssize_t n;
+
+			if (i < nr_outs - 1) n = tee(in, priv[STDOUT_FILENO], want, 0);
+			else n = splice(in, NULL, priv[STDOUT_FILENO], NULL, want, 0);
+			if (n < 0 && errno == EINTR) {
+				i--;
+				continue;
+			}
+			if (n < 0 || (i > 0 && n != len)) {
+				ret = -1;
+				break;
+			}
+			if (i == 0) len = n;
+			if (len == 0) break;
+			ret = drain_pipe(priv[STDIN_FILENO], outs[i], n);
+		}
+		if (len == 0) break;
+	}
+	close(priv[STDIN_FILENO]);
+	close(priv[STDOUT_FILENO]);
+	return ret;
+}
+
+static bool cat_accepts(int nr_tokens, char *tokens[])
+{
+	for (int i = 1; i < nr_tokens; i++) {
+		if (tokens[i][0] == '-' && tokens[i][1]) return false;
+	}
+	return true;
+}
+
+/***********************************************************************
+ * builtin_cat()
+ *
+ * DESCRIPTION
+ *   cat [FILE]...
+ *   Copy the files ("-" or none for stdin) to stdout with copy_fd(). Only
+ *   taken when there is no option (see cat_accepts()); otherwise the
+ *   external cat runs.
+ */
+static int builtin_cat(int nr_tokens, char *tokens[])
+{
+	int ret = 1;
+
+	// stdout 버퍼를 거치지 않고 fd에 바로 쓰므로 앞서 쓴 내용부터 내보냄
+	fflush(stdout);
+	if (nr_tokens == 1 && copy_fd(STDIN_FILENO, STDOUT_FILENO) < 0) {
+		fprintf(stderr, "cat: %s\n", strerror(errno));
+		return -1;
+	}
+	for (int i = 1; i < nr_tokens; i++) {
+		bool is_stdin = strcmp(tokens[i], "-") == 0;
+		int fd = is_stdin ? STDIN_FILENO : open(tokens[i], O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0 || copy_fd(fd, STDOUT_FILENO) < 0) {
+			fprintf(stderr, "cat: %s: %s\n", tokens[i], strerror(errno));
+			ret = -1;
+		}
+		if (fd >= 0 && !is_stdin) close(fd);
+	}
+	return ret;
+}
+
+static bool tee_accepts(int nr_tokens, char *tokens[])
+{
+	for (int i = 1; i < nr_tokens; i++) {
+		if (i == 1 && strcmp(tokens[i], "-a") == 0) continue;
+		if (tokens[i][0] == '-' && tokens[i][1]) return false;
+	}
+	return true;
+}
+
+/***********************************************************************
+ * builtin_tee()
+ *
+ * DESCRIPTION
+ *   tee [-a] [FILE]...
+ *   Copy stdin to stdout and to the files (appended with -a) with
+ *   tee_fds(). Other options are left to the external tee.
+ */
+static int builtin_tee(int nr_tokens, char *tokens[])
+{
+	bool append = nr_tokens > 1 && strcmp(tokens[1], "-a") == 0;
+	int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+	int outs[nr_tokens];
+	int nr_outs = 0, ret = 1;
+
+	fflush(stdout);
+	outs[nr_outs++] = STDOUT_FILENO;
+	for (int i = append ? 2 : 1; i < nr_tokens; i++) {
+		int fd = open(tokens[i], flags, 0666);
+
+		if (fd < 0) {
+			fprintf(stderr, "tee: %s: %s\n", tokens[i], strerror(errno));
+			ret = -1;
+			continue;
+		}
+		outs[nr_outs++] = fd;
+	}
+	if (tee_fds(STDIN_FILENO, outs, nr_outs) < 0) {
+		fprintf(stderr, "tee: %s\n", strerror(errno));
+		ret = -1;
+	}
+	for (int i = 1; i < nr_outs; i++) {
+		close(outs[i]);
+	}
+	return ret;
+}
+
+// parallel, pipe-map이 실행 중인 명령 하나, pid와 out이 모두 비어야 빈 슬롯
+struct parallel_slot {
+	pid_t pid;		// 아직 회수하지 않은 자식, 없으면 0
+	int out;		// 출력을 모아두는 memfd, 없으면 -1
+	unsigned long seq;	// 입력 순서, -k일 때 이 순서로 출력
+	int status;
+};
+
+// 자식의 출력을 어떻게 내보낼지
+enum parallel_output {
+	PARALLEL_DIRECT,	// stdout에 바로 씀
+	PARALLEL_BUFFERED,	// 명령마다 모았다가 끝나는 순서대로
+	PARALLEL_ORDERED,	// 명령마다 모았다가 입력 순서대로 (-k)
+};
+
+// run_parallel()에 명령을 하나씩 주는 쪽
+struct parallel_input {
+	// 다음 명령의 인자와 stdin을 정함, 입력이 끝났으면 0, 오류면 -1
+	int (*next)(struct parallel_input *input, char ***argv, int *in_fd);
+	// 자식을 띄운 후 next()가 준 것을 정리
+	void (*done)(struct parallel_input *input, char **argv, int in_fd);
+};
+
+// 슬롯의 자식 중 하나가 끝날 때까지 기다림, 실행 중인 자식이 없으면 NULL
+// SIGCHLD를 막은 상태에서 호출
+static struct parallel_slot *reap_parallel(struct parallel_slot slots[], int nr_slots,
+		const sigset_t *old)
+{
+	while (true) {
+		bool running = false;
+
+		for (int i = 0; i < nr_slots; i++) {
+			struct parallel_slot *slot = &slots[i];
+			struct rusage usage;
+			pid_t pid;
+
+			if (!slot->pid) continue;
+			running = true;
+			pid = wait4(slot->pid, &slot->status, WNOHANG, &usage);
+			if (pid == 0) continue;
+			if (pid == slot->pid) {
+				trace_reap(pid);
+				add_rusage(&pipeline_usage, &usage, NULL);
+			} else {
+				// 다른 곳에서 회수되어 상태를 알 수 없음
+				slot->status = W_EXITCODE(1, 0);
+			}
+			slot->pid = 0;
+			return slot;
+		}
+		if (!running) return NULL;
+		sigsuspend(old);
+	}
+}
+
+// 끝난 명령의 출력을 내보내고 슬롯을 비움, @next_seq가 있으면 앞 순서가 모두 나간 것만
+static void flush_parallel(struct parallel_slot slots[], int nr_slots, unsigned long *next_seq)
+{
+	for (int i = 0; i < nr_slots; i++) {
+		struct parallel_slot *slot = &slots[i];
+
+		if (slot->out < 0 || slot->pid) continue;
+		if (next_seq && slot->seq != *next_seq) continue;
+		lseek(slot->out, 0, SEEK_SET);
+		copy_fd(slot->out, STDOUT_FILENO);
+		close(slot->out);
+		slot->out = -1;
+		if (!next_seq) continue;
+		(*next_seq)++;
+		i = -1;	// 다음 순서의 슬롯을 처음부터 다시 찾음
+	}
+}
+
+/***********************************************************************
+ * run_parallel()
+ *
+ * DESCRIPTION
+ *   Run the commands given by @input, at most @nr_slots at a time, and
+ *   reap each of them as it finishes. A new command is taken only when a
+ *   slot is free. With buffered @output, a slot is free only after its
+ *   output is sent, so a slow command holds back at most @nr_slots - 1
+ *   commands after it.
+ *
+ * RETURN VALUE
+ *   Return 1 if every command exits with 0, or -1 otherwise
+ */
+static int run_parallel(struct parallel_input *input, int nr_slots, enum parallel_output output)
+{
+	static const struct redirect no_redirect;
+	struct parallel_slot slots[nr_slots];
+	unsigned long seq = 0, next_seq = 0;
+	int nr_busy = 0, ret = 1;
+	bool eof = false;
+	sigset_t old;
+
+	for (int i = 0; i < nr_slots; i++) {
+		slots[i] = (struct parallel_slot) { .pid = 0, .out = -1 };
+	}
+	// 자식의 출력보다 앞서 쓴 내용을 먼저 내보냄
+	fflush(stdout);
+
+	block_sigchld(&old);
+	while (true) {
+		// 빈 슬롯만큼 명령을 실행
+		while (!eof && nr_busy < nr_slots) {
+			struct parallel_slot *slot = NULL;
+			int out_fd = STDOUT_FILENO, in_fd;
+			char **argv;
+			int n = input->next(input, &argv, &in_fd);
+
+			if (n <= 0) {
+				if (n < 0) ret = -1;
+				eof = true;
+				break;
+			}
+			for (int i = 0; !slot; i++) {
+				if (!slots[i].pid && slots[i].out < 0) slot = &slots[i];
+			}
+			if (output != PARALLEL_DIRECT) {
+				slot->out = memfd_create("parallel", MFD_CLOEXEC);
+				// 출력을 모아둘 곳이 없으면 남은 입력은 실행하지 않음
+				if (slot->out < 0) {
+					input->done(input, argv, in_fd);
+					ret = -1;
+					eof = true;
+					break;
+				}
+				out_fd = slot->out;
+			}
+			slot->seq = seq++;
+			slot->pid = spawn_command(argv, in_fd, out_fd, &no_redirect, true);
+			input->done(input, argv, in_fd);
+			if (slot->pid < 0) {
+				// 실행하지 못한 명령도 순서를 지키려면 빈 출력으로 남겨둠
+				slot->pid = 0;
+				ret = -1;
+			}
+			nr_busy++;
+		}
+		if (output != PARALLEL_DIRECT) {
+			flush_parallel(slots, nr_slots, output == PARALLEL_ORDERED ? &next_seq : NULL);
+		}
+		nr_busy = 0;
+		for (int i = 0; i < nr_slots; i++) {
+			if (slots[i].pid || slots[i].out >= 0) nr_busy++;
+		}
+		if (nr_busy == 0 && eof) break;
+
+		struct parallel_slot *slot = reap_parallel(slots, nr_slots, &old);
+
+		if (slot && (!WIFEXITED(slot->status) || WEXITSTATUS(slot->status) != 0)) ret = -1;
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	return ret;
+}
+
+/***********************************************************************
+ * parse_parallel_options()
+ *
+ * DESCRIPTION
+ *   Parse "[-j N] [-k]" (and "[-b SIZE]" if @block is not NULL) at the
+ *   front of @tokens[] for parallel and pipe-map. N defaults to the number
+ *   of online CPUs.
+ *
+ * RETURN VALUE
+ *   Return the index of the command in @tokens[]
+ *   Return -1 after reporting an invalid option or a missing command
+ */
+static int parse_parallel_options(int nr_tokens, char *tokens[], long *nr_slots, bool *keep_order,
+		unsigned long long *block)
+{
+	int i;
+
+	*nr_slots = sysconf(_SC_NPROCESSORS_ONLN);
+	if (*nr_slots < 1) *nr_slots = 1;
+	*keep_order = false;
+	for (i = 1; i < nr_tokens && tokens[i][0] == '-'; i++) {
+		const char *value = tokens[i][1] && tokens[i][2] ? tokens[i] + 2 : tokens[i + 1];
+		char *end;
+
+		if (strcmp(tokens[i], "-k") == 0) {
+			*keep_order = true;
+			continue;
+		}
+		if (strncmp(tokens[i], "-j", 2) == 0) {
+			*nr_slots = value ? strtol(value, &end, 10) : 0;
+			if (!value || *end || *nr_slots <= 0) {
+				fprintf(stderr, "%s: invalid number of jobs\n", tokens[0]);
+				return -1;
+			}
+		} else if (block && strncmp(tokens[i], "-b", 2) == 0) {
+			if (!value || parse_size(value, block) < 0) {
+				fprintf(stderr, "%s: invalid block size\n", tokens[0]);
+				return -1;
+			}
+		} else {
+			break;
+		}
+		// 값이 다음 토큰으로 따로 온 경우
+		if (!tokens[i][2]) i++;
+	}
+	if (i >= nr_tokens) {
+		fprintf(stderr, "usage: %s [-j N] [-k]%s command [arg]...\n", tokens[0],
+				block ? " [-b size]" : "");
+		return -1;
+	}
+	return i;
+}
+
+// parallel: 입력 한 줄마다 명령 하나
+struct parallel_lines {
+	struct parallel_input input;
+	char **command;
+	int nr_args;
+	bool has_braces;
+	char **argv;		// nr_args + 2개
+	char *line;
+	size_t size;
+	int null_fd;		// 자식의 stdin
+};
+
+// @arg의 "{}"를 모두 @line으로 바꾼 문자열, 호출한 쪽에서 free
+static char *replace_braces(const char *arg, const char *line)
+{
+	size_t nr = 0, len = strlen(line);
+	char *result, *p;
+
+	for (const char *q = strstr(arg, "{}"); q; q = strstr(q + 2, "{}")) nr++;
+	result = p = malloc(strlen(arg) + nr * len + 1);
+	if (!result) return NULL;
+	for (const char *q; (q = strstr(arg, "{}")); arg = q + 2) {
+		p = mempcpy(p, arg, q - arg);
+		p = mempcpy(p, line, len);
+	}
+	strcpy(p, arg);
+	return result;
+}
+
+static int next_line(struct parallel_input *input, char ***argv, int *in_fd)
+{
+	struct parallel_lines *lines = container_of(input, struct parallel_lines, input);
+	ssize_t len;
+
+	// 빈 줄은 건너뜀
+	do {
+		len = getline(&lines->line, &lines->size, stdin);
+		if (len < 0) return 0;
+		if (len > 0 && lines->line[len - 1] == '\n') lines->line[--len] = '\0';
+	} while (len == 0);
+
+	for (int i = 0; i < lines->nr_args; i++) {
+		char *arg = lines->command[i];
+
+		lines->argv[i] = strstr(arg, "{}") ? replace_braces(arg, lines->line) : arg;
+	}
+	lines->argv[lines->nr_args] = lines->has_braces ? NULL : lines->line;
+	lines->argv[lines->nr_args + 1] = NULL;
+
+	*argv = lines->argv;
+	*in_fd = lines->null_fd;
+	return 1;
+}
+
+// 자식은 argv를 복사해 가므로 바꾼 인자는 실행 직후 해제함
+static void done_line(struct parallel_input *input, char **argv, int in_fd)
+{
+	struct parallel_lines *lines = container_of(input, struct parallel_lines, input);
+
+	for (int i = 0; i < lines->nr_args; i++) {
+		if (argv[i] != lines->command[i]) free(argv[i]);
+	}
+}
+
+/***********************************************************************
+ * builtin_parallel()
+ *
+ * DESCRIPTION
+ *   parallel [-j N] [-k] COMMAND [ARG]...
+ *   Run COMMAND once for each line of stdin with run_parallel(). Each "{}"
+ *   in the arguments is replaced with the line (also within an argument,
+ *   as in "{}.out"); with no "{}", the line is added as the last argument.
+ *   The commands get /dev/null as stdin and write to stdout directly, or
+ *   with -k, into a memory file each, sent out in the order of the lines.
+ */
+static int builtin_parallel(int nr_tokens, char *tokens[])
+{
+	struct parallel_lines lines = {
+		.input = { .next = next_line, .done = done_line },
+	};
+	long nr_slots;
+	bool keep_order;
+	int i = parse_parallel_options(nr_tokens, tokens, &nr_slots, &keep_order, NULL);
+	int ret;
+
+	if (i < 0) return -1;
+	lines.command = tokens + i;
+	lines.nr_args = nr_tokens - i;
+	for (int j = 0; j < lines.nr_args; j++) {
+		if (strstr(lines.command[j], "{}")) lines.has_braces = true;
+	}
+	lines.argv = malloc(sizeof(char *) * (lines.nr_args + 2));
+	lines.null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	if (!lines.argv || lines.null_fd < 0) {
+		free(lines.argv);
+		if (lines.null_fd >= 0) close(lines.null_fd);
+		return -1;
+	}
+
+	ret = run_parallel(&lines.input, nr_slots, keep_order ? PARALLEL_ORDERED : PARALLEL_DIRECT);
+
+	// 터미널에서 ^D로 끝낸 경우에도 셸이 계속 읽을 수 있게 함
+	clearerr(stdin);
+	free(lines.line);
+	free(lines.argv);
+	close(lines.null_fd);
+	return ret;
+}
+
+// pipe-map: 줄 단위로 자른 입력 블록마다 명령 하나
+#define PIPE_MAP_BLOCK (1 << 20)
+struct parallel_blocks {
+	struct parallel_input input;
+	char **command;
+	char *buf;
+	size_t len, size;
+	size_t block;		// 이만큼 모이면 마지막 줄 끝에서 자름
+	bool eof;
+};
+
+static int next_block(struct parallel_input *input, char ***argv, int *in_fd)
+{
+	struct parallel_blocks *blocks = container_of(input, struct parallel_blocks, input);
+	char *newline = NULL;
+	size_t scanned = 0, cut;
+	int fd;
+
+	// 블록 크기만큼 읽은 뒤 줄 끝이 나올 때까지 더 읽음 (한 줄이 블록보다 긴 경우)
+	while (!blocks->eof) {
+		size_t want;
+		ssize_t n;
+
+		if (blocks->len >= blocks->block) {
+			newline = memrchr(blocks->buf + scanned, '\n', blocks->len - scanned);
+			if (newline) break;
+			scanned = blocks->len;
+		}
+		if (blocks->len == blocks->size) {
+			char *buf = realloc(blocks->buf, blocks->size * 2);
+
+			if (!buf) return -1;
+			blocks->buf = buf;
+			blocks->size *= 2;
+		}
+		want = blocks->len < blocks->block ? blocks->block - blocks->len : blocks->size - blocks->len;
+		n = read(STDIN_FILENO, blocks->buf + blocks->len, want);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) return -1;
+		if (n == 0) blocks->eof = true;
+		blocks->len += n;
+	}
+	if (blocks->len == 0) return 0;
+	cut = newline ? (size_t)(newline - blocks->buf) + 1 : blocks->len;
+
+	// 자식이 처음부터 읽을 수 있도록 블록을 memfd에 담아서 stdin으로 줌
+	fd = memfd_create("pipe-map", MFD_CLOEXEC);
+	if (fd < 0 || write_all(fd, blocks->buf, cut) < 0) {
+		if (fd >= 0) close(fd);
+		return -1;
+	}
+	lseek(fd, 0, SEEK_SET);
+	memmove(blocks->buf, blocks->buf + cut, blocks->len - cut);
+	blocks->len -= cut;
+
+	*argv = blocks->command;
+	*in_fd = fd;
+	return 1;
+}
+
+static void done_block(struct parallel_input *input, char **argv, int in_fd)
+{
+	close(in_fd);
+}
+
+/***********************************************************************
+ * builtin_pipe_map()
+ *
+ * DESCRIPTION
+ *   pipe-map [-j N] [-k] [-b SIZE] COMMAND [ARG]...
+ *   Split stdin into blocks of about SIZE (1M by default) that end at a
+ *   line boundary, and run COMMAND on each block with run_parallel(), at
+ *   most N at a time, so that a single-threaded filter in the middle of a
+ *   pipeline (a | pipe-map grep x | b) uses N cores. Each block is a fresh
+ *   COMMAND with the block as its stdin. The output of each block is sent
+ *   out as a whole when it finishes, or in the order of the blocks with -k,
+ *   so lines from different blocks never interleave.
+ */
+static int builtin_pipe_map(int nr_tokens, char *tokens[])
+{
+	unsigned long long block = PIPE_MAP_BLOCK;
+	struct parallel_blocks blocks = {
+		.input = { .next = next_block, .done = done_block },
+	};
+	long nr_slots;
+	bool keep_order;
+	int i = parse_parallel_options(nr_tokens, tokens, &nr_slots, &keep_order, &block);
+	int ret;
+
+	if (i < 0) return -1;
+	blocks.command = tokens + i;
+	blocks.block = block;
+	blocks.size = block * 2;
+	blocks.buf = malloc(blocks.size);
+	if (!blocks.buf) return -1;
+
+	ret = run_parallel(&blocks.input, nr_slots, keep_order ? PARALLEL_ORDERED : PARALLEL_BUFFERED);
+
+	free(blocks.buf);
+	return ret;
+}
+
+// xargs: stdin의 항목을 ARG_MAX 안에 들어가는 만큼 묶어서 명령 하나
+#define XARGS_HEADROOM 2048	// 인자 크기 한도에서 남겨두는 여유, xargs와 같음
+struct xargs_batches {
+	struct parallel_input input;
+	char **command;
+	int nr_args;
+	size_t max_size;	// 인자 문자열과 포인터의 크기 한도
+	long max_items;		// 한 번에 넘길 항목 수, 0이면 제한 없음
+	char *buf;		// 읽은 입력, pos 앞은 이미 쓴 줄
+	size_t len, size, pos;
+	bool eof;
+	char **tokens;		// 지금 줄의 항목, next_token부터 아직 넘기지 않음
+	int max_tokens, nr_tokens, next_token;
+	char **argv;
+	int max_argv;
+	struct arena arena;	// 묶음의 항목, 명령을 띄우면 비움
+	int null_fd;		// 자식의 stdin
+};
+
+// 입력에서 다음 줄을 읽어서 항목으로 나눔, 입력이 끝났으면 0
+static int read_xargs_line(struct xargs_batches *batches)
+{
+	while (true) {
+		char *line = batches->buf + batches->pos;
+		char *newline = memchr(line, '\n', batches->len - batches->pos);
+		ssize_t n;
+
+		if (newline || (batches->eof && batches->pos < batches->len)) {
+			if (newline) *newline = '\0';
+			else batches->buf[batches->len] = '\0';
+			batches->pos = newline ? (size_t)(newline - batches->buf) + 1 : batches->len;
+			batches->nr_tokens = tokenize_command_alloc(line, &batches->tokens, &batches->max_tokens);
+			batches->next_token = 0;
+			return batches->nr_tokens < 0 ? -1 : 1;
+		}
+		if (batches->eof) return 0;
+
+		// 다 쓴 줄을 버리고, 한 줄이 버퍼보다 길면 늘림 (끝에 '\0' 자리를 남김)
+		memmove(batches->buf, batches->buf + batches->pos, batches->len - batches->pos);
+		batches->len -= batches->pos;
+		batches->pos = 0;
+		if (batches->len + 1 >= batches->size) {
+			char *buf = realloc(batches->buf, batches->size * 2);
+
+			if (!buf) return -1;
+			batches->buf = buf;
+			batches->size *= 2;
+		}
+		n = read(STDIN_FILENO, batches->buf + batches->len, batches->size - batches->len - 1);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) return -1;
+		if (n == 0) batches->eof = true;
+		batches->len += n;
+	}
+}
+
+static int next_batch(struct parallel_input *input, char ***argv, int *in_fd)
+{
+	struct xargs_batches *batches = container_of(input, struct xargs_batches, input);
+	size_t size = sizeof(char *);	// 끝의 NULL
+	int nr = batches->nr_args;
+
+	for (int i = 0; i < batches->nr_args; i++) {
+		size += strlen(batches->command[i]) + 1 + sizeof(char *);
+	}
+	while (true) {
+		char *item;
+		size_t item_size;
+
+		if (batches->next_token >= batches->nr_tokens) {
+			int ret = read_xargs_line(batches);
+
+			if (ret < 0) return -1;
+			if (ret == 0) break;
+			continue;
+		}
+		item = batches->tokens[batches->next_token];
+		item_size = strlen(item) + 1 + sizeof(char *);
+		// 항목 하나만으로 한도를 넘으면 그대로 넘겨서 exec가 실패하게 함
+		if (nr > batches->nr_args && (size + item_size > batches->max_size ||
+				(batches->max_items && nr - batches->nr_args == batches->max_items))) {
+			break;
+		}
+		if (nr + 1 >= batches->max_argv) {
+			int max_argv = batches->max_argv * 2;
+			char **grown = realloc(batches->argv, sizeof(char *) * max_argv);
+
+			if (!grown) return -1;
+			batches->argv = grown;
+			batches->max_argv = max_argv;
+		}
+		// 다음 줄을 읽으면 덮어쓰이므로 묶음이 끝날 때까지 arena에 둠
+		batches->argv[nr] = arena_strdup(&batches->arena, item);
+		if (!batches->argv[nr]) return -1;
+		nr++;
+		size += item_size;
+		batches->next_token++;
+	}
+	// 항목이 없으면 명령을 실행하지 않음 (GNU xargs -r)
+	if (nr == batches->nr_args) return 0;
+
+	memcpy(batches->argv, batches->command, sizeof(char *) * batches->nr_args);
+	batches->argv[nr] = NULL;
+	*argv = batches->argv;
+	*in_fd = batches->null_fd;
+	return 1;
+}
+
+static void done_batch(struct parallel_input *input, char **argv, int in_fd)
+{
+	struct xargs_batches *batches = container_of(input, struct xargs_batches, input);
+
+	arena_reset(&batches->arena);
+}
+
+// -P, -n, -s만 직접 처리하고 다른 옵션이 있으면 외부 xargs를 실행
+static bool xargs_accepts(int nr_tokens, char *tokens[])
+{
+	for (int i = 1; i < nr_tokens && tokens[i][0] == '-'; i++) {
+		if (!tokens[i][1] || !strchr("Pns", tokens[i][1])) return false;
+		if (!tokens[i][2]) i++;
+	}
+	return true;
+}
+
+/***********************************************************************
+ * builtin_xargs()
+ *
+ * DESCRIPTION
+ *   xargs [-P N] [-n MAX] [-s SIZE] [COMMAND [ARG]...]
+ *   Split stdin into items with the tokenizer of the shell and run COMMAND
+ *   (echo by default) with as many items as fit in ARG_MAX, less the
+ *   environment and some headroom, or in SIZE bytes, or at most MAX items.
+ *   Batches run through run_parallel(), at most N at a time (1 by default,
+ *   or the number of online CPUs if N is 0). Items are separated by
+ *   whitespace only; quotes and backslashes have no meaning, as in the
+ *   rest of the shell. COMMAND is not run if there is no item. Other
+ *   options are left to the external xargs (see xargs_accepts()).
+ */
+static int builtin_xargs(int nr_tokens, char *tokens[])
+{
+	static char *echo[] = { "echo", NULL };
+	struct xargs_batches batches = {
+		.input = { .next = next_batch, .done = done_batch },
+		.arena = ARENA_INIT,
+		.size = 64 << 10,
+		.max_argv = 64,
+	};
+	long arg_max = sysconf(_SC_ARG_MAX);
+	long nr_slots = 1;
+	size_t env_size = XARGS_HEADROOM;
+	int i, ret;
+
+	// 자식이 받는 환경은 셸 변수 중 export한 것
+	for (char **env = build_envp(); *env; env++) {
+		env_size += strlen(*env) + 1 + sizeof(char *);
+	}
+	batches.max_size = arg_max > 0 && (size_t)arg_max > env_size * 2 ? arg_max - env_size : env_size;
+	for (i = 1; i < nr_tokens && tokens[i][0] == '-'; i++) {
+		const char *value = tokens[i][2] ? tokens[i] + 2 : tokens[i + 1];
+		char *end;
+		long n = value ? strtol(value, &end, 10) : -1;
+
+		if (!value || *end || n < 0 || (n == 0 && tokens[i][1] != 'P')) {
+			fprintf(stderr, "xargs: invalid value for %.2s\n", tokens[i]);
+			return -1;
+		}
+		if (tokens[i][1] == 'P') {
+			nr_slots = n ? n : sysconf(_SC_NPROCESSORS_ONLN);
+		} else if (tokens[i][1] == 'n') {
+			batches.max_items = n;
+		} else if ((size_t)n < batches.max_size) {
+			batches.max_size = n;
+		}
+		if (!tokens[i][2]) i++;
+	}
+	if (nr_slots < 1) nr_slots = 1;
+	batches.command = i < nr_tokens ? tokens + i : echo;
+	batches.nr_args = i < nr_tokens ? nr_tokens - i : 1;
+	batches.max_argv += batches.nr_args;
+	batches.buf = malloc(batches.size);
+	batches.argv = malloc(sizeof(char *) * batches.max_argv);
+	batches.null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+	if (batches.buf && batches.argv && batches.null_fd >= 0) {
+		ret = run_parallel(&batches.input, nr_slots, PARALLEL_DIRECT);
+	} else {
+		ret = -1;
+	}
+
+	if (batches.null_fd >= 0) close(batches.null_fd);
+	free(batches.buf);
+	free(batches.argv);
+	free(batches.tokens);
+	arena_destroy(&batches.arena);
+	return ret;
+}
+
+// 내장 명령 테이블, 이름 순으로 정렬되어 있어야 함 (첫 글자로 시작 위치를 찾음)
+// accepts가 있으면 그 인자를 내장 명령이 처리할 수 있을 때만 쓰고, 아니면 외부 명령을 실행
+struct builtin {
+	const char *name;
+	int (*fn)(int nr_tokens, char *tokens[]);
+	bool (*accepts)(int nr_tokens, char *tokens[]);
+};
+
+static struct builtin builtins[] = {
+	{ "alias", builtin_alias, NULL },
+	{ "cat", builtin_cat, cat_accepts },
+	{ "cd", builtin_cd, NULL },
+	{ "echo", builtin_echo, NULL },
+	{ "exit", builtin_exit, NULL },
+	{ "export", builtin_export, NULL },
+	{ "false", builtin_false, NULL },
+	{ "fg", builtin_fg, NULL },
+	{ "hash", builtin_hash, NULL },
+	{ "jobs", builtin_jobs, NULL },
+	{ "parallel", builtin_parallel, NULL },
+	{ "pipe-map", builtin_pipe_map, NULL },
+	{ "printf", builtin_printf, NULL },
+	{ "pwd", builtin_pwd, NULL },
+	{ "set", builtin_set, NULL },
+	{ "spawnstat", builtin_spawnstat, NULL },
+	{ "tee", builtin_tee, tee_accepts },
+	{ "timestat", builtin_timestat, NULL },
+	{ "true", builtin_true, NULL },
+	{ "unset", builtin_unset, NULL },
+	{ "wait", builtin_wait, NULL },
+	{ "xargs", builtin_xargs, xargs_accepts },
+};
+#define NR_BUILTINS (sizeof(builtins) / sizeof(builtins[0]))
+
+// 첫 글자 -> 그 글자로 시작하는 첫 번째 내장 명령의 위치, 없으면 NR_BUILTINS
+static unsigned char builtin_start[256];
+
+static void init_builtins(void)
+{
+	memset(builtin_start, NR_BUILTINS, sizeof(builtin_start));
+	for (int i = NR_BUILTINS - 1; i >= 0; i--) {
+		builtin_start[(unsigned char)builtins[i].name[0]] = i;
+	}
+}
+
+// @argv를 처리할 내장 명령을 찾음, 없으면 외부 명령으로 실행
+static struct builtin *find_builtin(char *argv[])
+{
+	const char *name = argv[0];
+
+	for (unsigned int i = builtin_start[(unsigned char)name[0]];
+			i < NR_BUILTINS && builtins[i].name[0] == name[0]; i++) {
+		if (strcmp(builtins[i].name + 1, name + 1) != 0) continue;
+		if (builtins[i].accepts && !builtins[i].accepts(count_tokens(argv), argv)) return NULL;
+		return &builtins[i];
+	}
+	return NULL;
+}
+
+// 마지막 단계가 아닌 내장 명령은 자식에서 실행해서 파이프에 씀
+static pid_t spawn_builtin(struct builtin *builtin, char *argv[], int in_fd, int out_fd,
+		const struct redirect *redirect, int pipefd[][2], int nr_pipes)
+{
+	struct timespec start;
+	pid_t pid;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid = fork();
+	if (pid == -1) return -1;
+	if (pid == CHILD) {
+		int ret;
+
+		if (in_fd != STDIN_FILENO) dup2(in_fd, STDIN_FILENO);
+		if (out_fd != STDOUT_FILENO) dup2(out_fd, STDOUT_FILENO);
+		// exec를 하지 않으므로 close-on-exec 파이프도 직접 닫아야 다른 단계가 EOF를 받음
+		for (int j = 0; j < nr_pipes; j++) {
+			close(pipefd[j][STDIN_FILENO]);
+			close(pipefd[j][STDOUT_FILENO]);
+		}
+		if (apply_redirects(redirect) < 0) _exit(1);
+		stdout_direct = redirect_direct && redirect->path[STDOUT_FILENO];
+		ret = builtin->fn(count_tokens(argv), argv);
+		fflush(stdout);
+		_exit(ret >= 0 ? 0 : 1);
+	}
+	trace_spawn(pid, argv[0], &start, -1);
+	account_spawn(SPAWN_FORK, &start);
+	return pid;
+}
+
+// 셸 안에서 바로 실행, 파이프의 마지막 단계거나 리다이렉션이 있으면 잠깐 셸의 stdin 등을 바꿔서 실행
+static int run_builtin(struct builtin *builtin, char *argv[], int in_fd, const struct redirect *redirect)
+{
+	struct rusage before, after;
+	int saved[3] = { -1, -1, -1 };
+	int fds[3];
+	int ret;
+
+	if (open_redirects(redirect, fds) < 0) return -1;
+	if (in_fd != STDIN_FILENO && fds[STDIN_FILENO] < 0) {
+		fds[STDIN_FILENO] = fcntl(in_fd, F_DUPFD_CLOEXEC, 0);
+	}
+	// 바꾸기 전에 셸이 stdout에 써둔 것부터 내보냄
+	if (fds[STDOUT_FILENO] >= 0) fflush(stdout);
+	for (int fd = 0; fd < 3; fd++) {
+		if (fds[fd] < 0) continue;
+		saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		dup2(fds[fd], fd);
+		close(fds[fd]);
+	}
+	if (redirect->err_to_out) {
+		if (saved[STDERR_FILENO] < 0) saved[STDERR_FILENO] = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+		dup2(STDOUT_FILENO, STDERR_FILENO);
+	}
+	getrusage(RUSAGE_SELF, &before);
+	stdout_direct = redirect_direct && redirect->path[STDOUT_FILENO];
+	ret = builtin->fn(count_tokens(argv), argv);
+	stdout_direct = false;
+	// 뒤에 실행될 자식의 출력보다 먼저 나가도록 바로 비움
+	fflush(stdout);
+	getrusage(RUSAGE_SELF, &after);
+	add_rusage(&pipeline_usage, &after, &before);
+	for (int fd = 0; fd < 3; fd++) {
+		if (saved[fd] < 0) continue;
+		dup2(saved[fd], fd);
+		close(saved[fd]);
+	}
+	return ret;
+}
+
+// 마지막으로 실행한 파이프라인의 종료 상태, 0이면 성공
+static int last_status = 0;
+
+// 마지막으로 실행한 명령의 종료 상태, server.c가 결과로 돌려줌
+int command_status(void)
+{
+	return last_status;
+}
+
+// 명령 없이 리다이렉션만 있는 경우 (> file), 파일을 열었다가 닫기만 함
+static int create_redirects(const struct redirect *redirect)
+{
+	int fds[3];
+
+	if (open_redirects(redirect, fds) < 0) {
+		last_status = 1;
+		return 1;
+	}
+	for (int fd = 0; fd < 3; fd++) {
+		if (fds[fd] >= 0) close(fds[fd]);
+	}
+	last_status = 0;
+	return 1;
+}
+
+/***********************************************************************
+ * run_pipeline()
+ *
+ * DESCRIPTION
+ *   Run @nr_stages commands in @stages[] connected with pipes. Each
+ *   @stages[i] is a NULL-terminated argument vector, from which the
+ *   redirections are taken out first. A builtin in the last
+ *   stage runs in the shell itself; builtins in other stages run in forked
+ *   children. When @background is true, every stage runs in a child and
+ *   the stages are registered as a job instead of being waited for.
+ *
+ * RETURN VALUE
+ *   Return the value of the builtin if the last stage ran in the shell
+ *   Otherwise, return 1 on success, or <0 when a single command failed
+ */
+static int run_pipeline(int nr_stages, char **stages[], bool background)
+{
+	int pipefd[nr_stages - 1][2];
+	pid_t pids[nr_stages];
+	struct redirect redirects[nr_stages];
+	struct builtin *last = NULL;
+	int nr_pipes = 0, nr_spawned = 0, nr_children = nr_stages;
+	int in_fd = STDIN_FILENO;
+	int ret = 1, status = 0;
+
+	// 단계마다 리다이렉션을 떼어냄, 빈 단계가 있으면 (a | | b, | a 등) 실행하지 않음
+	for (int i = 0; i < nr_stages; i++) {
+		if (parse_redirects(stages[i], &redirects[i]) < 0) return -1;
+		if (stages[i][0]) continue;
+		// sh처럼 명령 없이 리다이렉션만 있으면 파일만 만들거나 비움
+		if (nr_stages == 1 && !background) return create_redirects(&redirects[0]);
+		return -1;
+	}
+	memset(&pipeline_usage, 0, sizeof(pipeline_usage));
+	// 마지막 단계의 내장 명령은 fork 없이 셸에서 실행
+	if (!background) last = find_builtin(stages[nr_stages - 1]);
+	if (last) nr_children--;
+
+	// 파이프는 fork 전에 전부 만들어 둬야 모든 단계가 동시에 돌 수 있음
+	// close-on-exec로 만들어서 자식이 exec할 때 쓰지 않는 파이프가 알아서 닫히게 함
+	for (; nr_pipes < nr_stages - 1; nr_pipes++) {
+		if (pipe2(pipefd[nr_pipes], O_CLOEXEC) == -1) {
+			ret = -1;
+			last = NULL;
+			nr_children = 0;
+			break;
+		}
+		// 사용자별 파이프 메모리 한도에 걸리면 기본 크기로 그냥 씀
+		if (pipe_size) fcntl(pipefd[nr_pipes][STDOUT_FILENO], F_SETPIPE_SZ, pipe_size);
+	}
+	for (int i = 0; i < nr_children; i++) {
+		// 첫 단계가 아니면 앞 파이프에서 읽고, 마지막 단계가 아니면 뒤 파이프에 씀
+		int in = i > 0 ? pipefd[i - 1][STDIN_FILENO] : STDIN_FILENO;
+		int out = i < nr_stages - 1 ? pipefd[i][STDOUT_FILENO] : STDOUT_FILENO;
+		struct builtin *builtin = find_builtin(stages[i]);
+		pid_t pid;
+
+		if (builtin) pid = spawn_builtin(builtin, stages[i], in, out, &redirects[i], pipefd, nr_pipes);
+		else pid = spawn_command(stages[i], in, out, &redirects[i], nr_stages > 1);
+
+		// 한 단계가 실행되지 않아도 나머지는 EOF를 받고 끝나므로 계속 진행
+		if (pid > 0) pids[nr_spawned++] = pid;
+	}
+
+	// 부모도 파이프를 다 닫아줘야 마지막 단계가 EOF를 받음, 셸에서 돌릴 단계의 입력만 남김
+	for (int j = 0; j < nr_pipes; j++) {
+		if (last && j == nr_pipes - 1) in_fd = pipefd[j][STDIN_FILENO];
+		else close(pipefd[j][STDIN_FILENO]);
+		close(pipefd[j][STDOUT_FILENO]);
+	}
+	if (last) {
+		ret = run_builtin(last, stages[nr_stages - 1], in_fd, &redirects[nr_stages - 1]);
+		if (in_fd != STDIN_FILENO) close(in_fd);
+	}
+
+	if (background && nr_spawned) {
+		int id = add_job(pids, nr_spawned, nr_stages, stages);
+		if (id > 0) {
+			fprintf(stderr, "[%d] %d\n", id, pids[nr_spawned - 1]);
+			last_status = 0;
+			return ret;
+		}
+		// 작업 테이블이 꽉 찼거나 메모리가 없으면 포그라운드처럼 기다림
+		fprintf(stderr, "mash: too many jobs\n");
+	}
+	// 실행된 단계는 전부 기다려서 좀비가 남지 않게 함, 종료 상태와 함께 자원 사용량도 받음
+	for (int i = 0; i < nr_spawned; i++) {
+		struct rusage usage;
+
+		if (wait4(pids[i], &status, 0, &usage) != pids[i]) continue;
+		trace_reap(pids[i]);
+		add_rusage(&pipeline_usage, &usage, NULL);
+	}
+
+	if (last) {
+		last_status = ret < 0 ? 1 : 0;
+		return ret;
+	}
+	if (nr_spawned < nr_children || nr_spawned == 0) {
+		// 마지막 단계는 실행조차 되지 않음
+		last_status = 127;
+	} else {
+		last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+	}
+	// 명령 하나만 실행했을 땐 종료 상태가 0이 아니면 실패, 파이프의 실패는 각 단계가 출력함
+	if (nr_stages == 1 && last_status != 0) return -1;
+	return ret;
+}
+
+/***********************************************************************
+ * time_pipeline()
+ *
+ * DESCRIPTION
+ *   Run a pipeline with run_pipeline() and add its wall-clock time and
+ *   resource usage to the session totals. When @report is true (i.e., the
+ *   pipeline is prefixed with "time"), the usage is also printed on stderr.
+ *   Background pipelines are not waited for here, so they are not counted.
+ *
+ * RETURN VALUE
+ *   Same as run_pipeline()
+ */
+static int time_pipeline(int nr_stages, char **stages[], bool background, bool report)
+{
+	struct timespec start, end;
+	unsigned long long ns;
+	int ret;
+
+	if (background) return run_pipeline(nr_stages, stages, background);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = run_pipeline(nr_stages, stages, background);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns = elapsed_ns(&start, &end);
+
+	nr_timed_pipelines++;
+	session_real_ns += ns;
+	add_usage(&session_usage, &pipeline_usage);
+	if (report) print_usage(ns, &pipeline_usage);
+	return ret;
+}
+
+// 파이프라인 하나를 실행함, 반환값은 run_command()와 같음
+static int execute_command(int nr_tokens, char *tokens[], bool background)
+{
+	int nr_stages = 1; //파이프라인 단계의 갯수 (파이프 갯수 + 1)
+	bool report = false;
+
+	// time 접두어는 파이프라인 전체에 걸림 (a | time b의 time은 그냥 명령어)
+	if (strcmp(tokens[0], "time") == 0) {
+		report = true;
+		tokens++;
+		nr_tokens--;
+		// time 하나만 있으면 아무것도 실행하지 않은 사용량을 출력
+		if (nr_tokens == 0) {
+			static const struct usage zero;
+
+			print_usage(0, &zero);
+			last_status = 0;
+			return 1;
+		}
+	}
+	// pipe가 몇 개 있는지 셈
+	for(int i = 0; i < nr_tokens; i++) {
+		if (strcmp(tokens[i], "|") == 0) {
+			nr_stages++;
+		}
+	}
+	//파이프가 존재하지 않는 경우
+	if (nr_stages == 1) {
+		return time_pipeline(1, &tokens, background, report);
+	}
+
+	// tokens를 직접 건드리지 않도록 포인터만 복사해서 "|" 자리에서 자름
+	char **argv = arena_alloc(&line_arena, sizeof(char *) * (nr_tokens + 1));
+	char **stages[nr_stages];
+	int nr = 0;
+
+	if (!argv) return -1;
+	stages[nr++] = argv;
+	for (int i = 0; i < nr_tokens; i++) {
+		if (strcmp(tokens[i], "|") == 0) {
+			argv[i] = NULL;
+			stages[nr++] = &argv[i + 1];
+		} else {
+			argv[i] = tokens[i];
+		}
+	}
+	argv[nr_tokens] = NULL;
+	return time_pipeline(nr_stages, stages, background, report);
+}
+
+/**
+ * Command substitution: a word "$(command)" is replaced with the words of
+ * what the command writes to stdout. Text before "$(" and after ")" in the
+ * same word is kept, as in "$(pwd)/file". The command may span several
+ * tokens ("$(ls -1 dir)") and may have its own substitutions. It runs in a
+ * forked shell whose stdout is a memfd. The parent then maps the memfd and
+ * splits the output in place, so a large output is never copied or read
+ * in small pieces. The words of the output are not parsed again for |, ;,
+ * redirections and the like, but they are when they appear in a word of
+ * their own (e.g., a "|" line in the output), because pipelines are split
+ * after substitution.
+ */
+struct subst_map {
+	void *addr;
+	size_t len;
+	struct subst_map *next;
+};
+// 치환 결과를 매핑한 영역, 토큰이 가리키므로 줄이 끝날 때 해제
+static struct subst_map *subst_maps;
+
+static void unmap_substitutions(void)
+{
+	for (struct subst_map *map = subst_maps; map; map = map->next) {
+		munmap(map->addr, map->len);
+	}
+	subst_maps = NULL;
+}
+
+// @token 안에서 $( 와 ) 를 따라 괄호 깊이를 바꿈, 깊이가 0이 되는 ) 위치를 @close에 둠
+static int subst_depth(const char *token, int depth, const char **close)
+{
+	for (const char *p = token; *p; p++) {
+		if (p[0] == '$' && p[1] == '(') {
+			depth++;
+			p++;
+		} else if (*p == ')' && depth > 0) {
+			if (--depth == 0 && close) {
+				*close = p;
+				return 0;
+			}
+		}
+	}
+	return depth;
+}
+
+int run_command(int nr_tokens, char *tokens[]);
+
+// @argv를 셸 명령으로 실행해서 stdout을 memfd로 받아 매핑함, 결과는 '\0'으로 끝남
+static char *capture_command(int nr_tokens, char *argv[])
+{
+	struct subst_map *map;
+	struct stat st;
+	char *output;
+	int status;
+	int fd = memfd_create("mash-subst", MFD_CLOEXEC);
+	pid_t pid;
+
+	if (fd < 0) return NULL;
+	fflush(stdout);
+	pid = fork();
+	if (pid == CHILD) {
+		int ret;
+
+		dup2(fd, STDOUT_FILENO);
+		// 셸과 같은 추적 파일에 버퍼가 두 번 나가지 않도록 자식은 추적하지 않음
+		trace.file = NULL;
+		ret = run_command(nr_tokens, argv);
+		if (ret < 0) fprintf(stderr, "Unable to execute %s\n", argv[0]);
+		fflush(stdout);
+		_exit(ret < 0 && last_status == 0 ? 1 : last_status);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+		close(fd);
+		return NULL;
+	}
+	// 치환 결과가 빈 명령이면 이 상태가 남음
+	last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+	// 뒤에 '\0' 한 바이트를 붙여서 그대로 문자열로 씀, 크기가 페이지 배수여도 안전
+	if (fstat(fd, &st) < 0 || ftruncate(fd, st.st_size + 1) < 0) {
+		close(fd);
+		return NULL;
+	}
+	// 자식이 쓴 페이지를 그대로 공유해서 복사 없이 제자리에서 토큰으로 나눔
+	output = mmap(NULL, st.st_size + 1, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (output == MAP_FAILED) return NULL;
+
+	map = arena_alloc(&line_arena, sizeof(*map));
+	if (!map) {
+		munmap(output, st.st_size + 1);
+		return NULL;
+	}
+	*map = (struct subst_map) { .addr = output, .len = st.st_size + 1, .next = subst_maps };
+	subst_maps = map;
+	return output;
+}
+
+// 줄 단위 arena에 있는 토큰 벡터 @vec (크기 *@size) 뒤에 @src를 붙임, 모자라면 두 배로 새로 잡음
+static char **append_tokens(char **vec, int *size, int nr, char *src[], int nr_src)
+{
+	if (nr + nr_src + 1 > *size) {
+		char **grown;
+
+		*size = (nr + nr_src + 1) * 2;
+		grown = arena_alloc(&line_arena, sizeof(char *) * *size);
+		if (!grown) return NULL;
+		if (nr) memcpy(grown, vec, sizeof(char *) * nr);
+		vec = grown;
+	}
+	if (nr_src) memcpy(vec + nr, src, sizeof(char *) * nr_src);
+	vec[nr + nr_src] = NULL;
+	return vec;
+}
+
+// @a와 @b를 이은 문자열, 줄 단위 arena에서 할당
+static char *concat_token(const char *a, const char *b)
+{
+	char *str = arena_alloc(&line_arena, strlen(a) + strlen(b) + 1);
+
+	if (str) strcpy(stpcpy(str, a), b);
+	return str;
+}
+
+/***********************************************************************
+ * substitute_commands()
+ *
+ * DESCRIPTION
+ *   Run each "$(command)" in @tokens[] and replace it with the words of
+ *   its output. @*result is set to @tokens when there is none. Otherwise
+ *   it is a NULL-terminated vector allocated from the line arena, with the
+ *   words pointing into the mapped output (see capture_command()).
+ *
+ * RETURN VALUE
+ *   Return the number of tokens in @*result
+ *   Return -1 on an unterminated "$(" or if the command cannot be run
+ */
+static int substitute_commands(int nr_tokens, char *tokens[], char ***result)
+{
+	// 출력을 나눈 단어, 바로 결과 벡터로 옮기므로 줄마다 다시 씀
+	static char **words;
+	static int max_words;
+	char **vec = NULL;
+	int nr = 0, size = 0;
+	bool found = false;
+
+	*result = tokens;
+	for (int i = 0; i < nr_tokens && !found; i++) {
+		if (strstr(tokens[i], "$(")) found = true;
+	}
+	if (!found) return nr_tokens;
+
+	for (int i = 0; i < nr_tokens; i++) {
+		char *open = strstr(tokens[i], "$(");
+		const char *close = NULL;
+		char *first, *last, *prefix, *suffix, *output;
+		char **inner;
+		int depth = 0, j, nr_inner = 0, nr_words;
+
+		if (!open) {
+			vec = append_tokens(vec, &size, nr, &tokens[i], 1);
+			if (!vec) return -1;
+			nr++;
+			continue;
+		}
+		// 닫는 괄호가 있는 토큰까지가 명령
+		for (j = i; j < nr_tokens; j++) {
+			depth = subst_depth(j == i ? open : tokens[j], depth, &close);
+			if (close) break;
+		}
+		if (!close) {
+			fprintf(stderr, "mash: unterminated $(\n");
+			return -1;
+		}
+
+		// alias의 토큰일 수도 있으므로 복사해서 자름
+		first = arena_strdup(&line_arena, tokens[i]);
+		last = i == j ? first : arena_strdup(&line_arena, tokens[j]);
+		inner = arena_alloc(&line_arena, sizeof(char *) * (j - i + 2));
+		if (!first || !last || !inner) return -1;
+		open = first + (open - tokens[i]);
+		suffix = last + (close - tokens[j]);
+		*open = '\0';
+		*suffix++ = '\0';
+		prefix = first;
+		if (open[2]) inner[nr_inner++] = open + 2;
+		for (int k = i + 1; k < j; k++) {
+			inner[nr_inner++] = tokens[k];
+		}
+		if (i != j && *last) inner[nr_inner++] = last;
+		inner[nr_inner] = NULL;
+
+		output = nr_inner ? capture_command(nr_inner, inner) : "";
+		if (!output) return -1;
+		nr_words = tokenize_command_alloc(output, &words, &max_words);
+		if (nr_words < 0) return -1;
+
+		// 앞뒤에 붙은 글자는 첫 단어와 마지막 단어에 붙임
+		if (*prefix || *suffix) {
+			if (nr_words == 0) words[nr_words++] = "";
+			if (*prefix && !(words[0] = concat_token(prefix, words[0]))) return -1;
+			if (*suffix && !(words[nr_words - 1] = concat_token(words[nr_words - 1], suffix))) {
+				return -1;
+			}
+		}
+		vec = append_tokens(vec, &size, nr, words, nr_words);
+		if (!vec) return -1;
+		nr += nr_words;
+		i = j;
+	}
+	// 전부 빈 출력으로 치환된 경우
+	if (!vec) vec = append_tokens(vec, &size, 0, NULL, 0);
+	*result = vec;
+	return vec ? nr : -1;
+}
+
+/**
+ * Variable expansion: $NAME, ${NAME}, $? (the last status) and $$ (the pid
+ * of the shell) are replaced with their values before command substitution
+ * runs. An unset variable is empty, and a word that becomes empty is
+ * dropped. The value is not split into words again. Text inside "$( )" is
+ * left to the shell that runs the command. A line of only NAME=value words
+ * sets shell variables; export makes them part of the environment.
+ */
+
 /***********************************************************************
- * run_command()
+ * expand_word()
  *
  * DESCRIPTION
- *   Implement the specified shell features here using the parsed
- *   command tokens.
+ *   Expand the variables in @token, writing the result to @out unless it
+ *   is NULL. @*depth is the "$(" nesting at the start of @token and is
+ *   updated to the one at its end.
  *
  * RETURN VALUE
- *   Return 1 on successful command execution
- *   Return 0 when user inputs "exit"
- *   Return <0 on error
+ *   Return the length of the result
+ *   Return -1 on a malformed "${"
  */
+static ssize_t expand_word(const char *token, int *depth, char *out)
+{
+	size_t len = 0;
 
-int run_command(int nr_tokens, char *tokens[])
+	for (const char *p = token; *p; p++) {
+		const char *value = NULL, *end;
+		size_t value_len;
+		char num[24];
+
+		if (p[0] == '$' && p[1] == '(') {
+			(*depth)++;
+		} else if (*p == ')' && *depth > 0) {
+			(*depth)--;
+		}
+		if (*p != '$' || *depth > 0) {
+			if (out) out[len] = *p;
+			len++;
+			continue;
+		}
+		if (p[1] == '?' || p[1] == '$') {
+			snprintf(num, sizeof(num), "%d", p[1] == '?' ? last_status : (int)shell_pid);
+			value = num;
+			p++;
+		} else if (p[1] == '{') {
+			end = name_end(p + 2);
+			if (end == p + 2 || *end != '}') return -1;
+			value = get_variable_n(p + 2, end - p - 2);
+			p = end;
+		} else if ((end = name_end(p + 1)) != p + 1) {
+			value = get_variable_n(p + 1, end - p - 1);
+			p = end - 1;
+		} else {
+			// 이름이 따라오지 않는 $는 그대로 둠
+			if (out) out[len] = '$';
+			len++;
+			continue;
+		}
+		if (!value) continue;
+		value_len = strlen(value);
+		if (out) memcpy(out + len, value, value_len);
+		len += value_len;
+	}
+	if (out) out[len] = '\0';
+	return len;
+}
+
+/***********************************************************************
+ * expand_variables()
+ *
+ * DESCRIPTION
+ *   Expand the variables in @tokens[]. @*result is set to @tokens when
+ *   there is no '$'. Otherwise it is a NULL-terminated vector allocated
+ *   from the line arena, as are the expanded words.
+ *
+ * RETURN VALUE
+ *   Return the number of tokens in @*result
+ *   Return -1 on a malformed "${" or if memory cannot be allocated
+ */
+static int expand_variables(int nr_tokens, char *tokens[], char ***result)
 {
-	if (strcmp(tokens[0], "exit") == 0) return 0; // exit일 경우
-	pid_t pid;
-	int status, status2, result = 0;
-	char *alias_tokens[MAX_NR_TOKENS] = { NULL }; // alias token화시킬 문자열
-	// alias가 있다면 alias 처리
-	if(!(list_empty(&stack))) {
-		int i;
-		alias_entry * pos;
-		//먼저 alias 순회
-		list_for_each_entry(pos, &stack, list) {
-			// 일단 nr_tokens만큼 처리하고 여기서 alias로 대체된 문자열이 있다면 그걸 대신해서 실행
-			for (i = 0; i < nr_tokens ; i++) {
-				//i번째 token이 alias로 지정한 이름과 같다면? 거기에 있는 command를 갖고옴
-				if(strcmp(tokens[i], pos->name) == 0) {
-					//execute command는 alias의 명령어임 name 같은 걸 이걸로 대체
-					char *execute_command = malloc(strlen(pos->command)+1);
-					// execute command에 복사 (alias command를 ㅇㅇ)
-					strcpy(execute_command, pos->command);
-					//execute_command를 자르고 리턴값은 자른 갯수
-					int nr_alias_tokens = parse_command(execute_command, alias_tokens); 
-					int nr_change_tokens = nr_tokens + nr_alias_tokens - 1; // 원래 xyz는 사라지니까 1을 빼줌
-					//새로운 토큰을 넣어줌
-					char **new_tokens = (char**)malloc(sizeof(char *)*(nr_change_tokens));
-					int j;
-					//토큰 길이만큼 동적할당
-					for (j = 0; j < nr_change_tokens; j++) {
-						new_tokens[j] = malloc(MAX_TOKEN_LEN);
-					}
-					//alias 전까진 기존 tokens 유지
-					for (j = 0; j < i; j++) {
-                    	new_tokens[j] = strdup(tokens[j]);
-                	}
-					//new_tokens에 alias 자른 문자열 넣기
-        	        for (int k = 0; k < nr_alias_tokens; j++, k++) {
-            	        new_tokens[j] = strdup(alias_tokens[k]);
-                	}
-					//new_tokens에 기존에 다른 tokens 넣기
-                	for (int k = i + 1; k < nr_tokens; j++, k++) {
-                    	new_tokens[j] = strdup(tokens[k]);
-                	}
-					//token에 옮겨줘여하니까 동적할당 해줘야함
-					tokens = (char**)malloc(sizeof(char*)*nr_change_tokens);
-					tokens = new_tokens;
-                	nr_tokens = nr_change_tokens;
-				}
-			}
+	char **vec;
+	int nr = 0, depth = 0;
+	bool found = false;
+
+	*result = tokens;
+	for (int i = 0; i < nr_tokens && !found; i++) {
+		if (strchr(tokens[i], '$')) found = true;
+	}
+	if (!found) return nr_tokens;
+
+	vec = arena_alloc(&line_arena, sizeof(char *) * (nr_tokens + 1));
+	if (!vec) return -1;
+	for (int i = 0; i < nr_tokens; i++) {
+		int start = depth;
+		ssize_t len;
+		char *word;
+
+		if (!strchr(tokens[i], '$') && !strchr(tokens[i], ')')) {
+			vec[nr++] = tokens[i];
+			continue;
 		}
-		// execvp 실행을 위해 마지막 문자를 null로 해줘야함...
-		tokens[i] = NULL;
+		// 길이를 먼저 재고 나서 씀
+		len = expand_word(tokens[i], &depth, NULL);
+		if (len < 0) {
+			fprintf(stderr, "mash: %s: bad substitution\n", tokens[i]);
+			return -1;
+		}
+		word = arena_alloc(&line_arena, len + 1);
+		if (!word) return -1;
+		expand_word(tokens[i], &start, word);
+		if (*word) vec[nr++] = word;
 	}
-	int nr_pipes = 0; //파이프의 갯수
-	int pipe_loc = 0; //파이프 위친
-	// pipe가 있는지 체크하고 파이프의 위치를 반환
-	for(int i = 0; i < nr_tokens; i++) {
-		if (strcmp(tokens[i], "|") == 0) {
-			pipe_loc = i;
-			nr_pipes++;
-		}
-	}
-	//파이프가 있는 경우, nr_pipes가 0이 아니면 파이프 존재
-	if(nr_pipes > 0) {
-		if (strcmp(tokens[0], "cd") == 0) {
-			//디렉토리를 변경할 경우, 두번째 토큰에 path가 전달됨 따라서 dir 문자열에 token의 두번째 토큰값 전달
-			char *dir = tokens[1]; 
-			//cd나 cd ~ 일 경우 사용자의 홈디렉토리로 변경
-			if (tokens[1] == NULL || strcmp(tokens[1], "~") == 0) {
-				dir = getenv("HOME"); 
-			}
-			//디렉토리 변경에 실패할 경우엔 -1 반환 아니면 1 반환
-			if (chdir(dir) != 0) { 
-				return -1; 
-			}
-			return 1; 
-		}
-		int pipefd[2];
-		if (pipe(pipefd) == -1) exit(1);
-		tokens[pipe_loc] = NULL;
-		// 왼쪽 자식 프로세스를 포크해줌
-		pid_t left_pid = fork();
-		// 부모 먼저 실행
-		if (left_pid != CHILD) {
-			close(pipefd[STDOUT_FILENO]);
-			// 오른쪽 포크해줌
-			pid_t right_pid = fork();
-			if (right_pid != CHILD) {
-				//닫아주고
-				close(pipefd[STDIN_FILENO]);
-				//자식 프로세스들이 끝날때까지 대기
-				waitpid(left_pid, &status, 0); 
-				waitpid(right_pid, &status2, 0);
-			}
-			//오른쪽 자식 프로세스
-			else if (right_pid == CHILD) {
-				dup2(pipefd[STDIN_FILENO], STDIN_FILENO);
-				close(pipefd[STDOUT_FILENO]);
-				result = execvp(tokens[pipe_loc+1], &tokens[pipe_loc+1]);
-				//반환값이 잘못되면 오류 출력하고 에러 반환되게
-				if (result == -1) {
-					fprintf(stderr, "Unable to execute %s\n", tokens[pipe_loc+1]);
-					close(pipefd[STDIN_FILENO]);
-					exit(1);
-				}
-				exit(0);
-			}
+	vec[nr] = NULL;
+	*result = vec;
+	return nr;
+}
+
+// NAME=value 꼴인 단어의 '=' 위치, 아니면 NULL
+static const char *assignment(const char *token)
+{
+	const char *end = name_end(token);
+
+	return end != token && *end == '=' ? end : NULL;
+}
+
+/***********************************************************************
+ * assign_variables()
+ *
+ * DESCRIPTION
+ *   Set the shell variables of a line made only of NAME=value words. The
+ *   value is expanded and substituted like any other word, and its words
+ *   are joined with a space ("A=$(ls dir)" keeps every name).
+ *
+ * RETURN VALUE
+ *   Return 0 if the variables are set
+ *   Return 1 if @tokens[] is not an assignment line (nothing is set)
+ *   Return -1 if a value cannot be expanded
+ */
+static int assign_variables(int nr_tokens, char *tokens[])
+{
+	int depth = 0;
+
+	// 명령 치환 안을 빼고 모든 단어가 NAME=value여야 함
+	for (int i = 0; i < nr_tokens; i++) {
+		if (depth == 0 && !assignment(tokens[i])) return 1;
+		depth = subst_depth(tokens[i], depth, NULL);
+	}
+
+	last_status = 0;
+	for (int i = 0, j; i < nr_tokens; i = j + 1) {
+		char **words;
+		char *entry, *p;
+		size_t size = 0;
+		int nr_words;
+
+		// 값이 걸친 토큰 [i, j]
+		depth = 0;
+		for (j = i; j < nr_tokens; j++) {
+			depth = subst_depth(tokens[j], depth, NULL);
+			if (depth == 0) break;
 		}
-		//왼쪽 자식 프로세스
-		else if (left_pid == CHILD){
-			dup2(pipefd[STDOUT_FILENO], STDOUT_FILENO);
-			close(pipefd[STDIN_FILENO]);
-			result = execvp(tokens[0], &tokens[0]);
-			if (result == -1) {
-				fprintf(stderr, "Unable to execute %s\n", tokens[0]);
-				close(pipefd[STDOUT_FILENO]);
-				exit(1);
-			}
-			exit(0);
+		if (j == nr_tokens) j = nr_tokens - 1;
+		nr_words = expand_variables(j - i + 1, tokens + i, &words);
+		if (nr_words >= 0) nr_words = substitute_commands(nr_words, words, &words);
+		if (nr_words <= 0) return -1;
+
+		for (int k = 0; k < nr_words; k++) {
+			size += strlen(words[k]) + 1;
 		}
-		return 1;
-	} 
-	//파이프가 존재하지 않는 경우
-	else {
-		// cd일 경우
-		if (strcmp(tokens[0], "cd") == 0) {
-			//디렉토리를 변경할 경우, 두번째 토큰에 path가 전달됨 따라서 dir 문자열에 token의 두번째 토큰값 전달
-			char *dir = tokens[1]; 
-			//cd나 cd ~ 일 경우 사용자의 홈디렉토리로 변경
-			if (tokens[1] == NULL || strcmp(tokens[1], "~") == 0) {
-				dir = getenv("HOME"); 
-			}
-			//디렉토리 변경에 실패할 경우엔 -1 반환 아니면 1 반환
-			if (chdir(dir) != 0) { 
-				return -1; 
-			}
-			return 1; 
-		} 
-		//alias 일 경우 내부 명령어기 때문에 fork 할 필요는 없음
-		if (strcmp(tokens[0], "alias") == 0) {
-			//alias 명령어를 추가하는 케이스도 생각해야 함 -> 이 때는 nr_tokens가 2개 이상임
-			if (nr_tokens > 1) {
-				//input size는 토큰길이의 맥스값이랑 토큰 개수의 맥스값을 곱해줌
-				int input_size = MAX_TOKEN_LEN * MAX_NR_TOKENS;
-				char *input_command = malloc(input_size);
-				// memset으로 문자열 뒤를 0으로 초기화해줌 -> strcpy나 strlen을 쓰기 위해서..
-				if (input_command != NULL) memset(input_command, 0, input_size);
-				alias_entry * add_alias = (alias_entry*)malloc(sizeof(alias_entry));
-				// alias xyz hello world가 들어올 땐 xyz 뒤의 hello world 전체가 들어옴 따라서 이걸 전부 다 고려 (공백도 두번 스페이스 되더라도 한개로 처리)
-				for (int i = 2; i < nr_tokens; i++) {
-					strcat(input_command, tokens[i]);
-					// input command에 공백도 고려해서 넘겨줌
-					if (i < nr_tokens - 1) {
-						strcat(input_command, " ");
-					}	
-				}
-				//command 문자열은 string으로 전달되기 때문에 동적할당으로 메모리할당을 해줘야함
-				add_alias->command = malloc(strlen(input_command)+1);
-				add_alias->name = malloc(strlen(tokens[1])+1);
-				//alias name에는 token[1]이 들어옴 
-				strcpy(add_alias->name, tokens[1]);
-				//alias command에는 input command가 들어옴
-				strcpy(add_alias->command, input_command);
-				//pa0처럼 stack에다 추가
-				list_add(&add_alias->list, &stack);
+		entry = p = arena_alloc(&line_arena, size);
+		if (!entry) return -1;
+		for (int k = 0; k < nr_words; k++) {
+			if (k) *p++ = ' ';
+			p = stpcpy(p, words[k]);
+		}
+		// 이름에는 $가 없으므로 펼친 뒤에도 NAME= 으로 시작함
+		p = (char *)assignment(entry);
+		*p = '\0';
+		if (set_variable(entry, p + 1, false) < 0) return -1;
+	}
+	return 0;
+}
+
+/**
+ * Glob expansion: a word with *, ? or [...] becomes the sorted paths that
+ * match it, or stays as it is when nothing matches. Each '/'-separated
+ * part of the pattern is matched in turn. A leading '.' must be matched
+ * explicitly, and "." and ".." are never matched by a pattern. mash has
+ * no quoting, so a backslash is an ordinary character.
+ *
+ * Directories are read with getdents64() into a cache of sorted names,
+ * keyed by path. On every use, the cache entry is checked against the
+ * device, inode and mtime of the directory. A glob over a large directory
+ * that has not changed therefore costs one stat() plus a scan of the
+ * cached names. The scan starts at a binary search for the literal prefix
+ * of the pattern. A directory modified in the same second as it was read
+ * may change again without a new mtime, so it is read again on next use.
+ */
+struct linux_dirent64 {
+	unsigned long long d_ino;
+	long long d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+typedef struct dir_cache {
+	struct hlist_node hash;
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	bool racy;	// mtime이 읽은 시각과 같은 초, 다음에 다시 읽음
+	int nr_names;
+	char **names;	// 이름 순으로 정렬, names[i][-1]은 d_type
+	char *pool;	// 이름들이 d_type, 이름, '\0' 순으로 들어 있음
+} dir_cache;
+#define DIR_CACHE_BUCKETS 64
+#define DIR_CACHE_MAX 64	// 넘으면 전부 비움
+#define GETDENTS_SIZE (64 << 10)
+static struct hlist_head dir_cache_table[DIR_CACHE_BUCKETS];
+static unsigned int nr_cached_dirs = 0;
+
+static void free_dir_cache(dir_cache *dir)
+{
+	hlist_del(&dir->hash);
+	free(dir->path);
+	free(dir->names);
+	free(dir->pool);
+	free(dir);
+	nr_cached_dirs--;
+}
+
+static void flush_dir_cache(void)
+{
+	dir_cache *pos;
+	struct hlist_node *tmp;
+
+	for (int i = 0; i < DIR_CACHE_BUCKETS; i++) {
+		hlist_for_each_entry_safe(pos, tmp, &dir_cache_table[i], hash) {
+			free_dir_cache(pos);
+		}
+	}
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// @fd의 항목을 모두 읽어서 @dir의 이름 목록을 만듦
+static int read_dir(int fd, dir_cache *dir)
+{
+	static char buf[GETDENTS_SIZE];
+	size_t *offsets = NULL, size = 0, max_size = 0;
+	int max_names = 0;
+	long len;
+
+	dir->nr_names = 0;
+	dir->pool = NULL;
+	while ((len = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+		for (long pos = 0; pos < len;) {
+			struct linux_dirent64 *ent = (struct linux_dirent64 *)(buf + pos);
+			size_t name_len = strlen(ent->d_name);
+
+			pos += ent->d_reclen;
+			if (size + name_len + 2 > max_size) {
+				char *pool;
+
+				max_size = (size + name_len + 2) * 2;
+				pool = realloc(dir->pool, max_size);
+				if (!pool) goto fail;
+				dir->pool = pool;
 			}
-			// alias 목록 리스트 출력할 케이스
-			else {
-				alias_entry *alias_list;
-				// alias에 저장된 명령어를 출력할 때 , readme에는 역순으로 출력함 따라서 reverse로 접근
-				list_for_each_entry_reverse(alias_list, &stack, list) {
-					fprintf(stderr, "%s: %s\n", alias_list->name, alias_list->command);
-				}
+			if (dir->nr_names == max_names) {
+				size_t *grown;
+
+				max_names = max_names ? max_names * 2 : 64;
+				grown = realloc(offsets, sizeof(*offsets) * max_names);
+				if (!grown) goto fail;
+				offsets = grown;
 			}
-			return 1;
+			// 풀은 자라면서 옮겨지므로 다 읽을 때까지는 위치만 둠
+			dir->pool[size] = ent->d_type;
+			offsets[dir->nr_names++] = size + 1;
+			memcpy(dir->pool + size + 1, ent->d_name, name_len + 1);
+			size += name_len + 2;
 		}
-		//fork의 반환을 pid에 저장
-		pid = fork();
-		//fork의 반환값이 0이라면, 자식 프로세스임
-		if(pid == 0){
-			//execvp의 반환값을 result에 저장, result가 -1이면 실패
-			result = execvp(tokens[0], tokens);
-			//execvp가 실패하면 에러 반환 및 부모 프로세스로 돌아감
-			if (result == -1) {
-				exit(1);	
+	}
+	if (len < 0) goto fail;
+
+	dir->names = malloc(sizeof(char *) * (dir->nr_names + 1));
+	if (!dir->names) goto fail;
+	for (int i = 0; i < dir->nr_names; i++) {
+		dir->names[i] = dir->pool + offsets[i];
+	}
+	qsort(dir->names, dir->nr_names, sizeof(char *), compare_names);
+	free(offsets);
+	return 0;
+
+fail:
+	free(offsets);
+	free(dir->pool);
+	return -1;
+}
+
+/***********************************************************************
+ * lookup_dir()
+ *
+ * DESCRIPTION
+ *   Return the cached names of the directory @path ("" for the current
+ *   directory), reading it again if it has changed since it was cached.
+ *
+ * RETURN VALUE
+ *   Return the cache entry, valid until the next call
+ *   Return NULL if @path is not a directory that can be read
+ */
+static dir_cache *lookup_dir(const char *path)
+{
+	unsigned int bucket = hash_string(path) & (DIR_CACHE_BUCKETS - 1);
+	struct timespec now;
+	struct stat st;
+	dir_cache *pos;
+	int fd;
+
+	if (stat(*path ? path : ".", &st) < 0 || !S_ISDIR(st.st_mode)) return NULL;
+	hlist_for_each_entry(pos, &dir_cache_table[bucket], hash) {
+		if (strcmp(pos->path, path) != 0) continue;
+		// cd 뒤의 상대 경로는 다른 디렉토리일 수 있으므로 inode까지 비교
+		if (!pos->racy && pos->dev == st.st_dev && pos->ino == st.st_ino &&
+				pos->mtime.tv_sec == st.st_mtim.tv_sec &&
+				pos->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+			return pos;
+		}
+		free_dir_cache(pos);
+		break;
+	}
+
+	// 읽기 전의 시각과 mtime을 재야 읽는 도중에 바뀐 것도 놓치지 않음
+	clock_gettime(CLOCK_REALTIME, &now);
+	fd = open(*path ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) return NULL;
+	pos = malloc(sizeof(*pos));
+	if (!pos || fstat(fd, &st) < 0 || !(pos->path = strdup(path))) {
+		free(pos);
+		close(fd);
+		return NULL;
+	}
+	if (read_dir(fd, pos) < 0) {
+		free(pos->path);
+		free(pos);
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	pos->dev = st.st_dev;
+	pos->ino = st.st_ino;
+	pos->mtime = st.st_mtim;
+	pos->racy = st.st_mtim.tv_sec >= now.tv_sec;
+
+	if (nr_cached_dirs >= DIR_CACHE_MAX) flush_dir_cache();
+	hlist_add_head(&pos->hash, &dir_cache_table[bucket]);
+	nr_cached_dirs++;
+	return pos;
+}
+
+static bool has_glob(const char *word)
+{
+	return strpbrk(word, "*?[") != NULL;
+}
+
+/***********************************************************************
+ * match_dir()
+ *
+ * DESCRIPTION
+ *   Append @prefix + name + @suffix to the vector @*vec (see
+ *   append_tokens()) for each name in the directory @prefix that matches
+ *   @pattern. With @dirs_only, names that cannot be a directory are
+ *   skipped; symlinks and unknown types are kept and fail later.
+ *
+ * RETURN VALUE
+ *   Return 0 on success (even if @prefix cannot be read)
+ *   Return -1 if memory cannot be allocated
+ */
+static int match_dir(const char *prefix, const char *pattern, const char *suffix,
+		bool dirs_only, char ***vec, int *size, int *nr)
+{
+	dir_cache *dir = lookup_dir(prefix);
+	size_t prefix_len = strlen(prefix), suffix_len = strlen(suffix);
+	size_t literal = strcspn(pattern, "*?[");
+	int lo = 0, hi;
+
+	if (!dir) return 0;
+	// 패턴 앞의 글자로 시작하는 이름부터 봄
+	hi = dir->nr_names;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (strncmp(dir->names[mid], pattern, literal) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	for (int i = lo; i < dir->nr_names && strncmp(dir->names[i], pattern, literal) == 0; i++) {
+		const char *name = dir->names[i];
+		unsigned char type = name[-1];
+		char *path;
+		size_t name_len;
+
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+		if (dirs_only && type != DT_DIR && type != DT_LNK && type != DT_UNKNOWN) continue;
+		if (fnmatch(pattern, name, FNM_PERIOD | FNM_NOESCAPE) != 0) continue;
+
+		name_len = strlen(name);
+		path = arena_alloc(&line_arena, prefix_len + name_len + suffix_len + 1);
+		if (!path) return -1;
+		memcpy(path, prefix, prefix_len);
+		memcpy(path + prefix_len, name, name_len);
+		memcpy(path + prefix_len + name_len, suffix, suffix_len + 1);
+		*vec = append_tokens(*vec, size, *nr, &path, 1);
+		if (!*vec) return -1;
+		(*nr)++;
+	}
+	return 0;
+}
+
+/***********************************************************************
+ * glob_word()
+ *
+ * DESCRIPTION
+ *   Expand the pattern @word one path component at a time, starting from
+ *   the current (or root) directory. Literal components before the first
+ *   pattern are not looked up; later ones must exist.
+ *
+ * RETURN VALUE
+ *   Return the number of paths in @*paths, allocated from the line arena
+ *   Return -1 if memory cannot be allocated
+ */
+static int glob_word(const char *word, char ***paths)
+{
+	char *pattern = arena_strdup(&line_arena, word);
+	char *component, *next;
+	char *root = word[0] == '/' ? "/" : "";
+	char **vec;
+	int nr = 1, size = 0;
+	bool globbed = false;
+
+	if (!pattern) return -1;
+	vec = append_tokens(NULL, &size, 0, &root, 1);
+	for (component = pattern; component && nr; component = next) {
+		char **matched = NULL;
+		int nr_matched = 0, matched_size = 0;
+		bool dirs_only;
+
+		next = strchr(component, '/');
+		if (next) {
+			*next++ = '\0';
+			while (*next == '/') next++;
+		}
+		if (!*component) continue;
+		// 뒤에 / 가 오면 디렉토리에만 맞음, 패턴 끝의 / 는 결과에도 남김
+		dirs_only = next != NULL;
+
+		if (!has_glob(component) &&
+				(!globbed || strcmp(component, ".") == 0 || strcmp(component, "..") == 0)) {
+			for (int i = 0; i < nr; i++) {
+				vec[i] = concat_token(vec[i], component);
+				if (!vec[i] || (dirs_only && !(vec[i] = concat_token(vec[i], "/")))) return -1;
 			}
-			else {
-			// 성공하면 exit(0)으로 부모 프로세스에게 정보 반환
-				exit(0);
+			continue;
+		}
+		globbed = true;
+		for (int i = 0; i < nr; i++) {
+			if (match_dir(vec[i], component, dirs_only ? "/" : "", dirs_only,
+					&matched, &matched_size, &nr_matched) < 0) {
+				return -1;
 			}
-		}	
-		//자식 프로세스가 끝날 때까지 부모 프로세스는 대기
-		wait(&status);
-		//stauts가 0이면 성공, 아니면 실패
-		if(status == 0) {
-			return 1;
 		}
-		else {
-			return -1;
+		vec = matched;
+		nr = nr_matched;
+	}
+	*paths = vec;
+	return globbed ? nr : 0;
+}
+
+/***********************************************************************
+ * expand_globs()
+ *
+ * DESCRIPTION
+ *   Replace each word of @tokens[] that is a pattern with the paths that
+ *   match it. @*result is set to @tokens when there is no pattern.
+ *   Otherwise it is a NULL-terminated vector allocated from the line
+ *   arena.
+ *
+ * RETURN VALUE
+ *   Return the number of tokens in @*result
+ *   Return -1 if memory cannot be allocated
+ */
+static int expand_globs(int nr_tokens, char *tokens[], char ***result)
+{
+	char **vec = NULL;
+	int nr = 0, size = 0;
+	bool found = false;
+
+	*result = tokens;
+	for (int i = 0; i < nr_tokens && !found; i++) {
+		if (has_glob(tokens[i])) found = true;
+	}
+	if (!found) return nr_tokens;
+
+	for (int i = 0; i < nr_tokens; i++) {
+		char **paths = NULL;
+		int nr_paths = has_glob(tokens[i]) ? glob_word(tokens[i], &paths) : 0;
+
+		if (nr_paths < 0) return -1;
+		// 맞는 것이 없으면 패턴을 그대로 넘김
+		if (nr_paths == 0) {
+			paths = &tokens[i];
+			nr_paths = 1;
 		}
-	}	
-	return -1;
+		vec = append_tokens(vec, &size, nr, paths, nr_paths);
+		if (!vec) return -1;
+		nr += nr_paths;
+	}
+	*result = vec;
+	return nr;
+}
+
+// 명령 목록(a ; b && c || d &)의 노드, 파이프라인 하나와 그 뒤에 오는 연산자
+enum list_op {
+	LIST_SEQ,	// ; 또는 & 또는 끝, 다음 노드는 항상 실행
+	LIST_AND,	// &&, 성공했을 때만 다음 노드 실행
+	LIST_OR,	// ||, 실패했을 때만 다음 노드 실행
+};
+
+struct list_node {
+	int nr_tokens;
+	char **tokens;		// 토큰 배열을 잘라서 가리킴, NULL로 끝남
+	bool background;	// & 로 끝난 파이프라인
+	enum list_op next;
+};
+
+/***********************************************************************
+ * parse_list()
+ *
+ * DESCRIPTION
+ *   Split @tokens[] at ";", "&", "&&" and "||" into @nodes[], which must
+ *   have room for @nr_tokens + 1 entries. The operators in @tokens[] are
+ *   replaced with NULL so that each node points to a NULL-terminated
+ *   slice of @tokens[]; nothing is copied.
+ *
+ * RETURN VALUE
+ *   Return the number of @nodes[]
+ *   Return -1 on a syntax error (e.g., an empty command around && or ||)
+ */
+static int parse_list(int nr_tokens, char *tokens[], struct list_node nodes[])
+{
+	int nr_nodes = 0, start = 0, depth = 0;
+
+	for (int i = 0; i < nr_tokens; i++) {
+		enum list_op op;
+		bool background = false;
+		bool in_subst = depth > 0;
+
+		// $( ) 안의 연산자는 치환할 명령의 것
+		depth = subst_depth(tokens[i], depth, NULL);
+		if (in_subst) continue;
+		if (strcmp(tokens[i], ";") == 0) {
+			op = LIST_SEQ;
+		} else if (strcmp(tokens[i], "&") == 0) {
+			op = LIST_SEQ;
+			background = true;
+		} else if (strcmp(tokens[i], "&&") == 0) {
+			op = LIST_AND;
+		} else if (strcmp(tokens[i], "||") == 0) {
+			op = LIST_OR;
+		} else {
+			continue;
+		}
+		if (i == start) return -1;
+		tokens[i] = NULL;
+		nodes[nr_nodes++] = (struct list_node) {
+			.nr_tokens = i - start,
+			.tokens = tokens + start,
+			.background = background,
+			.next = op,
+		};
+		start = i + 1;
+	}
+	if (start < nr_tokens) {
+		nodes[nr_nodes++] = (struct list_node) {
+			.nr_tokens = nr_tokens - start,
+			.tokens = tokens + start,
+			.background = false,
+			.next = LIST_SEQ,
+		};
+	} else if (nr_nodes == 0 || nodes[nr_nodes - 1].next != LIST_SEQ) {
+		// && 나 || 로 끝나면 뒤에 올 명령이 없음
+		return -1;
+	}
+	return nr_nodes;
+}
+
+// 노드 하나를 실행, 변수와 명령 치환은 앞 노드가 끝난 뒤에 해야 cd, $? 등이 반영됨
+static int execute_node(struct list_node *node)
+{
+	char **tokens = node->tokens;
+	int nr_tokens = node->nr_tokens;
+
+	// alias는 명령마다 치환, alias 정의 자체는 치환하지 않아야 같은 이름을 다시 정의할 수 있음
+	if (strcmp(tokens[0], "alias") != 0) nr_tokens = expand_aliases(nr_tokens, tokens, &tokens);
+	if (trace.file && !trace.expanded_ns) trace.expanded_ns = now_ns();
+	if (nr_tokens < 0) return -1;
+	// alias가 빈 문자열로 치환된 경우엔 할 일이 없음
+	if (nr_tokens == 0) return 1;
+
+	if (assignment(tokens[0])) {
+		int ret = assign_variables(nr_tokens, tokens);
+
+		if (ret < 0) last_status = 1;
+		if (ret <= 0) return 1;
+	}
+	nr_tokens = expand_variables(nr_tokens, tokens, &tokens);
+	if (nr_tokens >= 0) nr_tokens = substitute_commands(nr_tokens, tokens, &tokens);
+	// alias 정의에 넣은 패턴은 alias를 쓸 때 펼침
+	if (nr_tokens > 0 && strcmp(tokens[0], "alias") != 0) {
+		nr_tokens = expand_globs(nr_tokens, tokens, &tokens);
+	}
+	if (nr_tokens < 0) {
+		last_status = 1;
+		return 1;
+	}
+	// 빈 출력으로 치환되어 실행할 것이 없음, 상태는 치환한 명령의 것
+	if (nr_tokens == 0) return 1;
+	return execute_command(nr_tokens, tokens, node->background);
+}
+
+/***********************************************************************
+ * execute_list()
+ *
+ * DESCRIPTION
+ *   Parse @tokens[] into a command list once and run its pipelines from
+ *   left to right. A pipeline after && (||) is skipped when the last
+ *   status is non-zero (zero), and the status is carried over the skipped
+ *   pipeline, as in sh. Nothing is re-tokenized and skipping a pipeline
+ *   costs nothing but a comparison.
+ *
+ *   The failure of a command whose status is tested by && or || is not
+ *   an error. Other failures in a list are reported here.
+ *
+ * RETURN VALUE
+ *   Same as run_command()
+ */
+static int execute_list(int nr_tokens, char *tokens[])
+{
+	struct list_node *nodes = arena_alloc(&line_arena, sizeof(*nodes) * (nr_tokens + 1));
+	int nr_nodes;
+	int ret = 1;
+
+	if (!nodes) return -1;
+	nr_nodes = parse_list(nr_tokens, tokens, nodes);
+
+	if (nr_nodes < 0) {
+		fprintf(stderr, "mash: syntax error\n");
+		last_status = 2;
+		return 1;
+	}
+	// 명령이 하나뿐이면 지금까지와 똑같이 실패 메시지는 mash가 출력
+	if (nr_nodes == 1) {
+		return execute_node(&nodes[0]);
+	}
+
+	for (int i = 0; i < nr_nodes; i++) {
+		struct list_node *node = &nodes[i];
+
+		if (i > 0 && nodes[i - 1].next == LIST_AND && last_status != 0) continue;
+		if (i > 0 && nodes[i - 1].next == LIST_OR && last_status == 0) continue;
+
+		last_status = 0;
+		ret = execute_node(node);
+		if (ret == 0) return 0; // exit
+		if (ret < 0) {
+			if (last_status == 0) last_status = 1;
+			if (node->next == LIST_SEQ) {
+				fprintf(stderr, "Unable to execute %s\n", node->tokens[0]);
+			}
+		}
+	}
+	return 1;
+}
+
+/***********************************************************************
+ * run_command()
+ *
+ * DESCRIPTION
+ *   Implement the specified shell features here using the parsed
+ *   command tokens.
+ *
+ * RETURN VALUE
+ *   Return 1 on successful command execution
+ *   Return 0 when user inputs "exit"
+ *   Return <0 on error
+ */
+int run_command(int nr_tokens, char *tokens[])
+{
+	const char *command = tokens[0];
+	int ret;
+
+	if (trace.file) trace.run_ns = now_ns();
+	refresh_zygote();
+	// alias는 ; && || 로 나눈 뒤 명령마다 치환 (execute_node())
+	ret = execute_list(nr_tokens, tokens);
+
+	// 추적은 치환된 토큰을 가리키므로 arena를 비우기 전에 씀
+	if (trace.file) trace_emit(command, ret, last_status);
+	// 치환된 토큰도 더 이상 쓰지 않음, 매핑 목록이 arena에 있으므로 먼저 해제
+	unmap_substitutions();
+	// 이 줄에서 쓴 임시 메모리를 한꺼번에 돌려놓음
+	arena_reset(&line_arena);
+	// 치환된 토큰이 옛 alias를 가리킬 수 있으므로 줄이 끝난 뒤에 정리
+	compact_alias_pool();
+	return ret;
 }
+
 /***********************************************************************
  * initialize()
  *
@@ -263,6 +4369,24 @@ int run_command(int nr_tokens, char *tokens[])
  */
 int initialize(int argc, char * const argv[])
 {
+	// 백그라운드 작업은 SIGCHLD가 올 때 회수함, 끼어든 read/waitpid는 다시 시작
+	struct sigaction sa = {
+		.sa_handler = sigchld_handler,
+		.sa_flags = SA_RESTART | SA_NOCLDSTOP,
+	};
+
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGCHLD, &sa, NULL) < 0) return -1;
+	sigprocmask(SIG_SETMASK, NULL, &child_sigmask);
+	init_builtins();
+	shell_pid = getpid();
+	import_environ();
+	initialized = true;
+	// -o spawn=zygote, 환경과 시그널 설정을 마친 뒤 첫 명령 전에 fork
+	if (spawn_mode == SPAWN_ZYGOTE && start_zygote() < 0) {
+		fprintf(stderr, "Unable to start the zygote\n");
+		return -1;
+	}
 	return 0;
 }
 
@@ -276,4 +4400,10 @@ int initialize(int argc, char * const argv[])
  */
 void finalize(int argc, char * const argv[])
 {
+	stop_zygote();
+	arena_destroy(&line_arena);
+	free_alias_namespace(&default_aliases);
+	free_variable_namespace(&default_variables);
+	flush_dir_cache();
+	if (trace.file && trace.file != stderr) fclose(trace.file);
 }
@@ -16,21 +16,189 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#include <immintrin.h>
+#define HAVE_SSE2
+#endif
 
 #include "parser.h"
 
-int parse_command(char *command, char *tokens[])
+/**
+ * Delimiters are ' ' and '\t', '\n', '\v', '\f', '\r'. The latter five are
+ * the contiguous range 0x09-0x0d, so a byte is a delimiter if it is a space
+ * or if (byte - 0x09) is at most 4 as an unsigned value.
+ */
+#define CHUNK_SIZE	64	/* Bytes classified into a single 64-bit mask */
+
+static inline uint64_t __delim_mask_scalar(const char *p, size_t len)
+{
+	uint64_t mask = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = p[i];
+		if (c == ' ' || (unsigned char)(c - '\t') <= 4) {
+			mask |= 1ULL << i;
+		}
+	}
+	return mask;
+}
+
+#ifdef HAVE_SSE2
+static uint64_t __delim_mask_sse2(const char *p)
+{
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i four = _mm_set1_epi8(4);
+	uint64_t mask = 0;
+
+	for (int i = 0; i < CHUNK_SIZE / 16; i++) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i * 16));
+		__m128i ctl = _mm_sub_epi8(v, tab);
+		__m128i d = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+				_mm_cmpeq_epi8(_mm_min_epu8(ctl, four), ctl));
+		mask |= (uint64_t)(unsigned int)_mm_movemask_epi8(d) << (i * 16);
+	}
+	return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t __delim_mask_avx2(const char *p)
+{
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i four = _mm256_set1_epi8(4);
+	uint64_t mask = 0;
+
+	for (int i = 0; i < CHUNK_SIZE / 32; i++) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i * 32));
+		__m256i ctl = _mm256_sub_epi8(v, tab);
+		__m256i d = _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+				_mm256_cmpeq_epi8(_mm256_min_epu8(ctl, four), ctl));
+		mask |= (uint64_t)(unsigned int)_mm256_movemask_epi8(d) << (i * 32);
+	}
+	return mask;
+}
+
+static uint64_t __delim_mask_detect(const char *p);
+static uint64_t (*__delim_mask)(const char *p) = __delim_mask_detect;
+
+/* Pick the widest classifier on the first call */
+static uint64_t __delim_mask_detect(const char *p)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		__delim_mask = __delim_mask_avx2;
+	} else {
+		__delim_mask = __delim_mask_sse2;
+	}
+	return __delim_mask(p);
+}
+#else
+static uint64_t __delim_mask(const char *p)
+{
+	return __delim_mask_scalar(p, CHUNK_SIZE);
+}
+#endif
+
+/* Double the token vector; the first call allocates MAX_NR_TOKENS entries */
+static int __grow_tokens(char ***tokens, int *max_tokens)
 {
-	const char *delimiters = " \t\r\f\r\n\v";
-	char *curr;
+	int size = *max_tokens ? *max_tokens * 2 : MAX_NR_TOKENS;
+	char **grown;
+
+	if (size < *max_tokens) return -1;
+	grown = realloc(*tokens, sizeof(char *) * size);
+	if (!grown) return -1;
+	*tokens = grown;
+	*max_tokens = size;
+	return 0;
+}
+
+/**
+ * The vector is grown only if @grow is true. Both entry points pass a
+ * constant, so each gets its own copy of the loop without the other case.
+ */
+static inline __attribute__((always_inline))
+int __tokenize(char *command, char ***vector, int *max_vector, int grow)
+{
+	size_t len = strlen(command);
+	char **tokens = *vector;
+	int max_tokens = *max_vector;
 	int nr_tokens = 0;
+	uint64_t carry = 0;	/* 1 if the previous chunk ended inside a token */
+
+	if (grow && max_tokens < 1) {
+		if (__grow_tokens(vector, max_vector) < 0) return -1;
+		tokens = *vector;
+		max_tokens = *max_vector;
+	}
+
+	for (size_t base = 0; base < len; base += CHUNK_SIZE) {
+		size_t n = len - base;
+		uint64_t valid, word, prev, starts, ends;
+
+		if (n >= CHUNK_SIZE) {
+			n = CHUNK_SIZE;
+			valid = ~0ULL;
+			word = ~__delim_mask(command + base);
+		} else {
+			valid = (1ULL << n) - 1;
+			word = ~__delim_mask_scalar(command + base, n) & valid;
+		}
+
+		/**
+		 * A token starts at a non-delimiter whose predecessor is a
+		 * delimiter, and ends at a delimiter whose predecessor is not.
+		 */
+		prev = (word << 1) | carry;
+		starts = word & ~prev;
+		ends = ~word & valid & prev;
+
+		for (; starts; starts &= starts - 1) {
+			if (nr_tokens >= max_tokens - 1) {
+				if (!grow || __grow_tokens(vector, max_vector) < 0) {
+					tokens[nr_tokens] = NULL;
+					return -1;
+				}
+				tokens = *vector;
+				max_tokens = *max_vector;
+			}
+			tokens[nr_tokens++] = command + base + __builtin_ctzll(starts);
+		}
+		for (; ends; ends &= ends - 1) {
+			command[base + __builtin_ctzll(ends)] = '\0';
+		}
+		carry = (word >> (n - 1)) & 1;
+	}
+	tokens[nr_tokens] = NULL;
+
+	return nr_tokens;
+}
+
+int tokenize_command(char *command, char *tokens[], int max_tokens)
+{
+	return __tokenize(command, &tokens, &max_tokens, 0);
+}
+
+int tokenize_command_alloc(char *command, char ***tokens, int *max_tokens)
+{
+	return __tokenize(command, tokens, max_tokens, 1);
+}
+
+int parse_command(char *command, char *tokens[])
+{
+	int nr_tokens = tokenize_command(command, tokens, MAX_NR_TOKENS);
 
-	while ((curr = strtok(command, delimiters))) {
-		*tokens++ = strdup(curr);
-		nr_tokens++;
-		command = NULL;
+	if (nr_tokens < 0) {
+		/* The slices are not ours to free */
+		tokens[0] = NULL;
+		return nr_tokens;
+	}
+	for (int i = 0; i < nr_tokens; i++) {
+		tokens[i] = strdup(tokens[i]);
 	}
-	*tokens = NULL;
 
 	return nr_tokens;
 }
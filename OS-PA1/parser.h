@@ -16,10 +16,54 @@
 #ifndef __PARSER_H__
 #define __PARSER_H__
 
+/**
+ * These bound only @parse_command and callers of @tokenize_command with a
+ * fixed array. mash reads lines of any length into a growing buffer and
+ * tokenizes them with @tokenize_command_alloc.
+ */
 #define MAX_NR_TOKENS	32	/* Maximum length of tokens in a command */
 #define MAX_TOKEN_LEN	128	/* Maximum length of single token */
 #define MAX_COMMAND_LEN	4096 /* Maximum length of assembly string */
 
+/***********************************************************************
+ * tokenize_command()
+ *
+ * DESCRIPTION
+ *  Split @command into tokens in place. Each token is a slice of @command;
+ *  the delimiter following each token is overwritten with '\0' so that the
+ *  slices can be used as ordinary strings (e.g., for execvp()). Nothing is
+ *  allocated, so the tokens are valid as long as @command is, and they must
+ *  not be passed to @free_command_tokens.
+ *
+ *  Delimiters are classified 64 bytes at a time with SSE2 or AVX2 byte
+ *  masks when the CPU supports them.
+ *
+ *  @tokens[] has room for @max_tokens entries including the terminating
+ *  NULL.
+ *
+ * RETURN VALUE
+ *  Return the number of @tokens[]
+ *  Return -1 if @command has more than @max_tokens - 1 tokens
+ */
+int tokenize_command(char *command, char *tokens[], int max_tokens);
+
+
+/***********************************************************************
+ * tokenize_command_alloc()
+ *
+ * DESCRIPTION
+ *  Same as @tokenize_command, but *@tokens is a heap vector of *@max_tokens
+ *  entries that is doubled with realloc() as long as @command has more
+ *  tokens, so there is no limit on the number of tokens. Start with
+ *  *@tokens = NULL and *@max_tokens = 0, keep the vector across calls to
+ *  reuse it, and free() it at the end.
+ *
+ * RETURN VALUE
+ *  Return the number of *@tokens
+ *  Return -1 if the vector cannot be grown
+ */
+int tokenize_command_alloc(char *command, char ***tokens, int *max_tokens);
+
 
 /***********************************************************************
  * parse_command()
@@ -39,10 +83,13 @@
  *    tokens[>=4] = NULL
  *
  *  Each token is allocated from the heap, so you need to deallcate them by 
- *  calling @free_command_tokens after use.
+ *  calling @free_command_tokens after use. This is a compatibility wrapper
+ *  of @tokenize_command for the callers that keep tokens longer than
+ *  @command; @tokens[] has room for MAX_NR_TOKENS entries.
  *
  * RETURN VALUE
  *  Return the number of @tokens[]
+ *  Return -1 if @command has too many tokens
  *
  */
 int parse_command(char *command, char *tokens[]);
@@ -19,6 +19,10 @@
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 
 const char *msg = "Hello world!\n";
 
@@ -27,8 +31,128 @@ void sighandler(int signal)
 	fprintf(stderr, "%d: SIGPIPE\n", signal);
 }
 
-int main(int argc, const char *argv[])
+/**
+ * pipe -b [-s MiB]: pipe throughput benchmark. A child drains the pipe
+ * while the parent pushes the given amount of data into it with write()
+ * or vmsplice(), for every combination of the write sizes and pipe
+ * capacities below. Capacities above /proc/sys/fs/pipe-max-size are
+ * skipped unless the user may exceed it.
+ */
+#define MAX_WRITE_SIZE	(1 << 20)
+
+static const size_t write_sizes[] = { 4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20 };
+static const int pipe_sizes[] = { 64 << 10, 256 << 10, 1 << 20 };
+#define NR_WRITE_SIZES	(sizeof(write_sizes) / sizeof(write_sizes[0]))
+#define NR_PIPE_SIZES	(sizeof(pipe_sizes) / sizeof(pipe_sizes[0]))
+
+static char buf[MAX_WRITE_SIZE] __attribute__((aligned(4096)));
+
+/**
+ * Push @total bytes into @fd, @size bytes at a time. vmsplice() maps the
+ * pages of @buf into the pipe instead of copying them, so @buf must not be
+ * changed while they are in the pipe; it never changes here.
+ */
+static int push(int fd, size_t total, size_t size, int use_vmsplice)
+{
+	while (total) {
+		size_t len = total < size ? total : size;
+		ssize_t ret;
+
+		if (use_vmsplice) {
+			struct iovec iov = { .iov_base = buf, .iov_len = len };
+			ret = vmsplice(fd, &iov, 1, 0);
+		} else {
+			ret = write(fd, buf, len);
+		}
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		total -= ret;
+	}
+	return 0;
+}
+
+/**
+ * Return MB/s of pushing @total bytes through a pipe of @pipe_size bytes,
+ * or a negative value if the pipe cannot be set up.
+ */
+static double measure(size_t total, size_t size, int pipe_size, int use_vmsplice)
+{
+	static char sink[MAX_WRITE_SIZE];
+	struct timespec start, end;
+	int fd[2];
+	pid_t pid;
+	int ret;
+
+	if (pipe(fd) < 0) return -1;
+	if (fcntl(fd[1], F_SETPIPE_SZ, pipe_size) < 0) {
+		close(fd[0]);
+		close(fd[1]);
+		return -1;
+	}
+
+	pid = fork();
+	if (pid < 0) return -1;
+	if (pid == 0) {
+		close(fd[1]);
+		while (read(fd[0], sink, sizeof(sink)) > 0);
+		_exit(EXIT_SUCCESS);
+	}
+	close(fd[0]);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = push(fd[1], total, size, use_vmsplice);
+	close(fd[1]);
+	waitpid(pid, NULL, 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (ret < 0) return -1;
+	return (total / 1e6) / ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+static int benchmark(size_t total)
 {
+	static const char *methods[] = { "write", "vmsplice" };
+
+	memset(buf, 'x', sizeof(buf));
+	printf("%-9s %8s %8s %10s\n", "method", "write", "pipe", "MB/s");
+	for (int m = 0; m < 2; m++) {
+		for (unsigned int p = 0; p < NR_PIPE_SIZES; p++) {
+			for (unsigned int w = 0; w < NR_WRITE_SIZES; w++) {
+				double mbps = measure(total, write_sizes[w], pipe_sizes[p], m);
+
+				if (mbps < 0) {
+					printf("%-9s %7zuK %7dK %10s\n", methods[m],
+							write_sizes[w] >> 10, pipe_sizes[p] >> 10, "-");
+					continue;
+				}
+				printf("%-9s %7zuK %7dK %10.1f\n", methods[m],
+						write_sizes[w] >> 10, pipe_sizes[p] >> 10, mbps);
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char * const argv[])
+{
+	size_t total = 256 << 20;
+	int bench = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "bs:")) != -1) {
+		switch (opt) {
+		case 'b':
+			bench = 1;
+			break;
+		case 's':
+			total = strtoul(optarg, NULL, 0) << 20;
+			break;
+		}
+	}
+	if (bench) return benchmark(total);
+
 	/*
 	struct sigaction sa = {
 		.sa_handler = sighandler,
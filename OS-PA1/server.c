@@ -0,0 +1,670 @@
+/**********************************************************************
+ * Copyright (c) 2020-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "list_head.h"
+#include "parser.h"
+#include "server.h"
+
+struct alias_namespace;
+struct variable_namespace;
+
+extern int run_command(int nr_tokens, char *tokens[]);
+extern int command_status(void);
+extern struct alias_namespace *new_alias_namespace(void);
+extern void free_alias_namespace(struct alias_namespace *ns);
+extern struct alias_namespace *use_alias_namespace(struct alias_namespace *ns);
+extern struct variable_namespace *new_variable_namespace(void);
+extern void free_variable_namespace(struct variable_namespace *ns);
+extern struct variable_namespace *use_variable_namespace(struct variable_namespace *ns);
+
+#define MAX_EVENTS	64
+#define READ_CHUNK	(64 << 10)
+/* Stop reading the output of a line while this much waits for the client */
+#define MAX_PENDING	(1 << 20)
+
+enum watch_type {
+	WATCH_LISTEN,
+	WATCH_SIGNAL,
+	WATCH_CLIENT,
+	WATCH_STDOUT,
+	WATCH_STDERR,
+};
+
+/* What an epoll event is about */
+struct watch {
+	enum watch_type type;
+	int fd;
+	struct session *session;
+};
+
+/**
+ * A client connection. Lines are taken from @in one at a time. A line
+ * runs in a child whose stdout and stderr are read through pipes, and
+ * it is finished when the child is reaped and both pipes reach EOF.
+ */
+struct session {
+	struct list_head list;
+	struct watch client;
+	struct watch out[2];		/* stdout, stderr of the line; fd -1 if closed */
+	int cwd;			/* O_PATH descriptor of the current directory */
+	struct alias_namespace *aliases;
+	struct variable_namespace *variables;
+
+	char *in;			/* Grows up to max_line to hold a whole line */
+	size_t in_len;
+	size_t in_size;
+	bool eof;			/* The client closed its side */
+	bool discarding;		/* Skipping the rest of a too long line */
+	bool dead;			/* The client is gone; finish the line and drop */
+
+	char *pending;			/* Frames not sent yet */
+	size_t pending_len;
+	size_t pending_size;
+	bool paused;			/* Output pipes are not read while too much is pending */
+
+	pid_t pid;			/* Child running the line, 0 if none */
+	bool reaped;
+	int status;
+	struct rusage usage;
+	struct timespec start;
+};
+
+static LIST_HEAD(sessions);
+static LIST_HEAD(closed);		/* Freed after the events at hand are handled */
+static int epfd = -1;
+static int base_cwd = -1;		/* Where the server started; new sessions start here */
+static struct watch listen_watch = { .type = WATCH_LISTEN, .fd = -1 };
+static struct watch signal_watch = { .type = WATCH_SIGNAL, .fd = -1 };
+static sigset_t old_mask;
+static size_t max_line;			/* ARG_MAX; a longer line is not run */
+
+static void __watch(struct watch *watch, int op, unsigned int events)
+{
+	struct epoll_event ev = { .events = events, .data.ptr = watch };
+
+	epoll_ctl(epfd, op, watch->fd, &ev);
+}
+
+static void __update_client(struct session *session)
+{
+	unsigned int events = session->pending_len ? EPOLLOUT : 0;
+
+	/* Do not take more input than one line buffer */
+	if (!session->eof && session->in_len < max_line) events |= EPOLLIN;
+	__watch(&session->client, EPOLL_CTL_MOD, events);
+}
+
+static void __pause_output(struct session *session, bool pause)
+{
+	if (session->paused == pause) return;
+	session->paused = pause;
+	for (int i = 0; i < 2; i++) {
+		if (session->out[i].fd >= 0) {
+			__watch(&session->out[i], EPOLL_CTL_MOD, pause ? 0 : EPOLLIN);
+		}
+	}
+}
+
+/* The client cannot be talked to anymore; finish the line and drop the session */
+static void __drop_client(struct session *session)
+{
+	if (session->dead) return;
+	session->dead = true;
+	session->eof = true;
+	session->in_len = 0;
+	epoll_ctl(epfd, EPOLL_CTL_DEL, session->client.fd, NULL);
+}
+
+/* Send what is pending without blocking; the rest goes on EPOLLOUT */
+static void __flush(struct session *session)
+{
+	size_t sent = 0;
+
+	while (sent < session->pending_len) {
+		ssize_t n = send(session->client.fd, session->pending + sent,
+				session->pending_len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+		if (n < 0) {
+			/* Nobody to send to; keep running the line but drop its output */
+			__drop_client(session);
+			sent = session->pending_len;
+			break;
+		}
+		sent += n;
+	}
+	memmove(session->pending, session->pending + sent, session->pending_len - sent);
+	session->pending_len -= sent;
+
+	if (session->pending_len < MAX_PENDING) __pause_output(session, false);
+	if (!session->dead) __update_client(session);
+}
+
+static void __send_frame(struct session *session, int type, const void *data, size_t len)
+{
+	struct mash_frame frame = { .type = type, .len = len };
+	size_t need = session->pending_len + sizeof(frame) + len;
+
+	if (session->dead) return;
+	if (need > session->pending_size) {
+		size_t size = session->pending_size ? session->pending_size : READ_CHUNK;
+		char *pending;
+
+		while (size < need) size *= 2;
+		pending = realloc(session->pending, size);
+		if (!pending) return;
+		session->pending = pending;
+		session->pending_size = size;
+	}
+	memcpy(session->pending + session->pending_len, &frame, sizeof(frame));
+	memcpy(session->pending + session->pending_len + sizeof(frame), data, len);
+	session->pending_len = need;
+
+	if (session->pending_len >= MAX_PENDING) __pause_output(session, true);
+	__flush(session);
+}
+
+static void __send_exit(struct session *session, int status, const struct rusage *ru)
+{
+	struct mash_exit result = { .status = status };
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	result.real_ns = (end.tv_sec - session->start.tv_sec) * 1000000000ULL +
+		end.tv_nsec - session->start.tv_nsec;
+	if (ru) {
+		result.utime_us = ru->ru_utime.tv_sec * 1000000ULL + ru->ru_utime.tv_usec;
+		result.stime_us = ru->ru_stime.tv_sec * 1000000ULL + ru->ru_stime.tv_usec;
+		result.maxrss_kb = ru->ru_maxrss;
+		result.nvcsw = ru->ru_nvcsw;
+		result.nivcsw = ru->ru_nivcsw;
+		result.majflt = ru->ru_majflt;
+		result.minflt = ru->ru_minflt;
+	}
+	__send_frame(session, MASH_FRAME_EXIT, &result, sizeof(result));
+}
+
+static void __close_session(struct session *session)
+{
+	if (!session->dead) epoll_ctl(epfd, EPOLL_CTL_DEL, session->client.fd, NULL);
+	close(session->client.fd);
+	session->client.fd = -1;
+	close(session->cwd);
+	free_alias_namespace(session->aliases);
+	free_variable_namespace(session->variables);
+	free(session->in);
+	free(session->pending);
+	/* Events of this round may still point at it */
+	list_move(&session->list, &closed);
+}
+
+static void __free_closed(void)
+{
+	struct session *session, *tmp;
+
+	list_for_each_entry_safe(session, tmp, &closed, list) {
+		list_del(&session->list);
+		free(session);
+	}
+}
+
+/* Send the output of a builtin that ran in the server, kept in @fd */
+static void __send_captured(struct session *session, int type, int fd)
+{
+	char buf[READ_CHUNK];
+	ssize_t n;
+
+	lseek(fd, 0, SEEK_SET);
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		__send_frame(session, type, buf, n);
+	}
+	close(fd);
+}
+
+/* NAME=value */
+static bool __is_assignment(const char *token)
+{
+	const char *p = token;
+
+	if (!isalpha((unsigned char)*p) && *p != '_') return false;
+	while (isalnum((unsigned char)*p) || *p == '_') p++;
+	return *p == '=';
+}
+
+/**
+ * alias, cd, export, unset and NAME=value change the state of the session,
+ * so a line with nothing but one of them runs in the server. Its output is
+ * captured in memory files and sent afterwards. A command substitution
+ * would block the server while it runs, so such a line runs in a child
+ * and its changes are lost like those of any other command.
+ */
+static bool __runs_in_server(int nr_tokens, char *tokens[])
+{
+	static const char *const builtins[] = { "alias", "cd", "export", "unset" };
+	bool assigning = __is_assignment(tokens[0]);
+	bool found = assigning;
+
+	for (size_t i = 0; !found && i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+		found = strcmp(tokens[0], builtins[i]) == 0;
+	}
+	if (!found) return false;
+	for (int i = 0; i < nr_tokens; i++) {
+		if (strpbrk(tokens[i], "|;&<>`") || strstr(tokens[i], "$(")) return false;
+		/* Not an assignment line; mash has no NAME=value prefix for commands */
+		if (assigning && !__is_assignment(tokens[i])) return false;
+	}
+	return true;
+}
+
+static void __run_in_server(struct session *session, int nr_tokens, char *tokens[])
+{
+	int out = memfd_create("mash-stdout", MFD_CLOEXEC);
+	int err = memfd_create("mash-stderr", MFD_CLOEXEC);
+	int saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	int saved_err = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+	int status;
+
+	if (out < 0 || err < 0 || saved_out < 0 || saved_err < 0) {
+		static const char msg[] = "Unable to capture the output\n";
+		int fds[] = { out, err, saved_out, saved_err };
+
+		for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+			if (fds[i] >= 0) close(fds[i]);
+		}
+		__send_frame(session, MASH_FRAME_STDERR, msg, sizeof(msg) - 1);
+		__send_exit(session, 126, NULL);
+		return;
+	}
+
+	fflush(stdout);
+	dup2(out, STDOUT_FILENO);
+	dup2(err, STDERR_FILENO);
+	if (run_command(nr_tokens, tokens) < 0) {
+		fprintf(stderr, "Unable to execute %s\n", tokens[0]);
+		status = command_status() ? command_status() : 1;
+	} else {
+		status = command_status();
+	}
+	fflush(stdout);
+	dup2(saved_out, STDOUT_FILENO);
+	dup2(saved_err, STDERR_FILENO);
+	close(saved_out);
+	close(saved_err);
+
+	/* cd may have moved the server; that is now where the session is */
+	if (strcmp(tokens[0], "cd") == 0) {
+		int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+
+		if (cwd >= 0) {
+			close(session->cwd);
+			session->cwd = cwd;
+		}
+	}
+	__send_captured(session, MASH_FRAME_STDOUT, out);
+	__send_captured(session, MASH_FRAME_STDERR, err);
+	__send_exit(session, status, NULL);
+}
+
+static int __run_in_child(struct session *session, int nr_tokens, char *tokens[])
+{
+	int out[2], err[2];
+	pid_t pid;
+
+	if (pipe2(out, O_CLOEXEC) < 0) return -1;
+	if (pipe2(err, O_CLOEXEC) < 0) {
+		close(out[0]);
+		close(out[1]);
+		return -1;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		int null = open("/dev/null", O_RDONLY);
+		int ret;
+
+		dup2(null, STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		dup2(err[1], STDERR_FILENO);
+		/* Do not keep other clients and their pipes open */
+		close_range(3, ~0U, 0);
+		sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+		ret = run_command(nr_tokens, tokens);
+		if (ret < 0) fprintf(stderr, "Unable to execute %s\n", tokens[0]);
+		fflush(stdout);
+		if (ret < 0 && command_status() == 0) _exit(1);
+		_exit(command_status());
+	}
+	close(out[1]);
+	close(err[1]);
+	if (pid < 0) {
+		close(out[0]);
+		close(err[0]);
+		return -1;
+	}
+
+	session->pid = pid;
+	session->reaped = false;
+	session->out[0] = (struct watch) { .type = WATCH_STDOUT, .fd = out[0], .session = session };
+	session->out[1] = (struct watch) { .type = WATCH_STDERR, .fd = err[0], .session = session };
+	for (int i = 0; i < 2; i++) {
+		__watch(&session->out[i], EPOLL_CTL_ADD, session->paused ? 0 : EPOLLIN);
+	}
+	return 0;
+}
+
+/* Start the next line of @session if nothing is running. Return false if the session is closed */
+static bool __next_line(struct session *session)
+{
+	/* Only used until the line is started, so shared by the sessions */
+	static char *line, **tokens;
+	static size_t line_size;
+	static int max_tokens;
+
+	while (!session->pid) {
+		char *newline = memchr(session->in, '\n', session->in_len);
+		size_t len;
+		int nr_tokens;
+
+		if (session->discarding) {
+			/* Drop input up to the '\n' that ends the too long line */
+			len = newline ? (size_t)(newline - session->in) + 1 : session->in_len;
+			memmove(session->in, session->in + len, session->in_len - len);
+			session->in_len -= len;
+			if (!newline && !session->eof) break;
+			session->discarding = false;
+			continue;
+		}
+		if (newline) {
+			len = newline - session->in + 1;
+		} else if (session->in_len >= max_line) {
+			/* Running either part of a cut line could do anything; run none */
+			static const char msg[] = "Line too long\n";
+
+			session->in_len = 0;
+			session->discarding = true;
+			clock_gettime(CLOCK_MONOTONIC, &session->start);
+			__send_frame(session, MASH_FRAME_STDERR, msg, sizeof(msg) - 1);
+			__send_exit(session, 2, NULL);
+			continue;
+		} else if (session->eof) {
+			/* The last line without '\n' */
+			len = session->in_len;
+		} else {
+			break;
+		}
+		if (len == 0) {
+			/* Nothing more will come; close after the frames are sent */
+			if (session->dead || !session->pending_len) {
+				__close_session(session);
+				return false;
+			}
+			break;
+		}
+
+		if (len + 1 > line_size) {
+			char *grown = realloc(line, len + 1);
+
+			if (!grown) break;
+			line = grown;
+			line_size = len + 1;
+		}
+		memcpy(line, session->in, len);
+		line[len] = '\0';
+		memmove(session->in, session->in + len, session->in_len - len);
+		session->in_len -= len;
+
+		clock_gettime(CLOCK_MONOTONIC, &session->start);
+		nr_tokens = tokenize_command_alloc(line, &tokens, &max_tokens);
+		if (nr_tokens < 0) {
+			static const char msg[] = "Too many tokens\n";
+
+			__send_frame(session, MASH_FRAME_STDERR, msg, sizeof(msg) - 1);
+			__send_exit(session, 2, NULL);
+			continue;
+		}
+		if (nr_tokens == 0) {
+			__send_exit(session, 0, NULL);
+			continue;
+		}
+		if (nr_tokens == 1 && strcmp(tokens[0], "exit") == 0) {
+			session->eof = true;
+			session->in_len = 0;
+			__send_exit(session, 0, NULL);
+			continue;
+		}
+
+		/* The line sees the aliases, variables and directory of its session */
+		if (fchdir(session->cwd) < 0) {
+			__send_exit(session, 1, NULL);
+			continue;
+		}
+		use_alias_namespace(session->aliases);
+		use_variable_namespace(session->variables);
+		if (__runs_in_server(nr_tokens, tokens)) {
+			__run_in_server(session, nr_tokens, tokens);
+		} else if (__run_in_child(session, nr_tokens, tokens) < 0) {
+			__send_exit(session, 126, NULL);
+		}
+		use_alias_namespace(NULL);
+		use_variable_namespace(NULL);
+	}
+	if (!session->dead) __update_client(session);
+	return true;
+}
+
+/* The line is done when its child is reaped and its output is drained */
+static void __finish_line(struct session *session)
+{
+	if (!session->pid || !session->reaped) return;
+	if (session->out[0].fd >= 0 || session->out[1].fd >= 0) return;
+
+	session->pid = 0;
+	__send_exit(session, session->status, &session->usage);
+	__next_line(session);
+}
+
+static void __accept(void)
+{
+	while (true) {
+		int fd = accept4(listen_watch.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		struct session *session;
+
+		if (fd < 0) return;
+		session = calloc(1, sizeof(*session));
+		if (!session) {
+			close(fd);
+			continue;
+		}
+		session->client = (struct watch) { .type = WATCH_CLIENT, .fd = fd, .session = session };
+		session->out[0].fd = session->out[1].fd = -1;
+		session->cwd = fcntl(base_cwd, F_DUPFD_CLOEXEC, 0);
+		session->aliases = new_alias_namespace();
+		session->variables = new_variable_namespace();
+		session->in_size = MAX_COMMAND_LEN;
+		session->in = malloc(session->in_size);
+		if (session->cwd < 0 || !session->aliases || !session->variables || !session->in) {
+			if (session->cwd >= 0) close(session->cwd);
+			if (session->aliases) free_alias_namespace(session->aliases);
+			if (session->variables) free_variable_namespace(session->variables);
+			free(session->in);
+			free(session);
+			close(fd);
+			continue;
+		}
+		list_add_tail(&session->list, &sessions);
+		__watch(&session->client, EPOLL_CTL_ADD, EPOLLIN);
+	}
+}
+
+static void __client_event(struct session *session, unsigned int events)
+{
+	if (events & EPOLLOUT) __flush(session);
+
+	if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+		ssize_t n;
+
+		/* No complete line fits; double the buffer up to max_line */
+		if (session->in_len == session->in_size && session->in_size < max_line) {
+			size_t size = session->in_size * 2 < max_line ? session->in_size * 2 : max_line;
+			char *in = realloc(session->in, size);
+
+			if (in) {
+				session->in = in;
+				session->in_size = size;
+			}
+		}
+		n = read(session->client.fd, session->in + session->in_len,
+				session->in_size - session->in_len);
+		if (n > 0) {
+			session->in_len += n;
+		} else if (n == 0) {
+			session->eof = true;
+		} else if (errno != EAGAIN && errno != EINTR) {
+			__drop_client(session);
+		}
+		if (events & (EPOLLHUP | EPOLLERR)) __drop_client(session);
+	}
+	if (session->dead && !session->pid) {
+		__close_session(session);
+		return;
+	}
+	__next_line(session);
+}
+
+static void __output_event(struct watch *watch)
+{
+	struct session *session = watch->session;
+	char buf[READ_CHUNK];
+	ssize_t n = read(watch->fd, buf, sizeof(buf));
+
+	if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+	if (n > 0) {
+		__send_frame(session, watch->type == WATCH_STDOUT ? MASH_FRAME_STDOUT : MASH_FRAME_STDERR,
+				buf, n);
+		return;
+	}
+	epoll_ctl(epfd, EPOLL_CTL_DEL, watch->fd, NULL);
+	close(watch->fd);
+	watch->fd = -1;
+	__finish_line(session);
+}
+
+static void __reap(void)
+{
+	struct signalfd_siginfo info;
+	struct rusage usage;
+	int status;
+	pid_t pid;
+
+	while (read(signal_watch.fd, &info, sizeof(info)) == sizeof(info));
+
+	while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+		struct session *session;
+
+		list_for_each_entry(session, &sessions, list) {
+			if (session->pid != pid) continue;
+			session->reaped = true;
+			session->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+			session->usage = usage;
+			__finish_line(session);
+			break;
+		}
+	}
+}
+
+int run_server(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct epoll_event events[MAX_EVENTS];
+	struct stat st;
+	sigset_t mask;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	max_line = sysconf(_SC_ARG_MAX) > 0 ? (size_t)sysconf(_SC_ARG_MAX) : 2 << 20;
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+	base_cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	listen_watch.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (base_cwd < 0 || listen_watch.fd < 0 ||
+			bind(listen_watch.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			listen(listen_watch.fd, SOMAXCONN) < 0) {
+		return -1;
+	}
+
+	/* Children are reaped from the event loop; each line gets the old mask back */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, &old_mask);
+	signal_watch.fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (signal_watch.fd < 0 || epfd < 0) return -1;
+
+	__watch(&listen_watch, EPOLL_CTL_ADD, EPOLLIN);
+	__watch(&signal_watch, EPOLL_CTL_ADD, EPOLLIN);
+
+	while (true) {
+		int nr = epoll_wait(epfd, events, MAX_EVENTS, -1);
+
+		for (int i = 0; i < nr; i++) {
+			struct watch *watch = events[i].data.ptr;
+
+			/* Closed by an earlier event of this round */
+			if (watch->fd < 0 || (watch->session && watch->session->client.fd < 0)) continue;
+
+			switch (watch->type) {
+			case WATCH_LISTEN:
+				__accept();
+				break;
+			case WATCH_SIGNAL:
+				__reap();
+				break;
+			case WATCH_CLIENT:
+				__client_event(watch->session, events[i].events);
+				break;
+			case WATCH_STDOUT:
+			case WATCH_STDERR:
+				__output_event(watch);
+				break;
+			}
+		}
+		__free_closed();
+	}
+	return 0;
+}
@@ -0,0 +1,71 @@
+/**********************************************************************
+ * Copyright (c) 2020-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <stdint.h>
+
+/**
+ * Protocol of the server mode (mash -S). A client writes command lines to
+ * the socket, each terminated with '\n', and reads frames back. The lines
+ * of a connection run one at a time in order, with their own aliases,
+ * shell variables and current directory; lines of different connections
+ * run concurrently.
+ *
+ * Every frame is a struct mash_frame followed by @len bytes of payload.
+ * The output of a line comes in MASH_FRAME_STDOUT and MASH_FRAME_STDERR
+ * frames, and every line ends with one MASH_FRAME_EXIT frame whose payload
+ * is a struct mash_exit. All fields are in host byte order.
+ */
+enum mash_frame_type {
+	MASH_FRAME_STDOUT = 'o',
+	MASH_FRAME_STDERR = 'e',
+	MASH_FRAME_EXIT = 'x',
+};
+
+struct mash_frame {
+	uint8_t type;
+	uint8_t __pad[3];
+	uint32_t len;
+};
+
+struct mash_exit {
+	int32_t status;		/* Same as $? of sh */
+	uint32_t __pad;
+	uint64_t real_ns;	/* From the start of the line to its end */
+	uint64_t utime_us;	/* The rest is from wait4(), zero for lines run */
+	uint64_t stime_us;	/* in the server itself (alias, cd, ...) */
+	int64_t maxrss_kb;
+	int64_t nvcsw;
+	int64_t nivcsw;
+	int64_t majflt;
+	int64_t minflt;
+};
+
+
+/***********************************************************************
+ * run_server()
+ *
+ * DESCRIPTION
+ *  Listen on the Unix domain socket at @path and serve the clients until
+ *  the server is killed. A stale socket file at @path is replaced.
+ *
+ * RETURN VALUE
+ *  Return -1 if the socket cannot be set up; otherwise it does not return
+ */
+int run_server(const char *path);
+
+#endif
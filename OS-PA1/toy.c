@@ -19,20 +19,115 @@
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
+#include <getopt.h>
 
-int main(int argc, const char *argv[])
+/**
+ * Besides printing its arguments, toy works as a load generator for the
+ * benchmark (make bench). The options run in the order below:
+ *  -c N	Burn the CPU for N iterations
+ *  -m M	Touch M MiB of memory
+ *  -r	Read stdin until EOF
+ *  -w K	Write K bytes to stdout
+ *  -x C	Exit with C
+ *  -q	Do not print the arguments
+ */
+#define BUF_SIZE	(64 << 10)
+
+static char buf[BUF_SIZE];
+
+static void burn_cpu(unsigned long long iterations)
+{
+	volatile unsigned long long x = 0;
+
+	for (unsigned long long i = 0; i < iterations; i++) {
+		x += i * i;
+	}
+}
+
+static void touch_memory(size_t mib)
 {
-	fprintf(stderr, "pid  = %d\n", getpid());
-	fprintf(stderr, "argc = %d\n", argc);
+	size_t size = mib << 20;
+	long page = sysconf(_SC_PAGESIZE);
+	char *mem = malloc(size);
 
-	for (int i = 0; i < argc; i++) {
-		fprintf(stderr, "argv[%d] = %s\n", i, argv[i]);
+	if (!mem) return;
+	for (size_t i = 0; i < size; i += page) {
+		mem[i] = 1;
 	}
+	free(mem);
+}
+
+static void drain_stdin(void)
+{
+	while (read(STDIN_FILENO, buf, sizeof(buf)) > 0);
+}
+
+static void write_stdout(unsigned long long bytes)
+{
+	memset(buf, 'x', sizeof(buf));
+	while (bytes) {
+		size_t len = bytes < sizeof(buf) ? bytes : sizeof(buf);
+		ssize_t ret = write(STDOUT_FILENO, buf, len);
 
-	if (argc > 2 && strcmp(argv[1], "zzz") == 0) {
-		sleep(atoi(argv[2]));
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		bytes -= ret;
 	}
-	fprintf(stderr, "done!\n");
+}
+
+int main(int argc, char * const argv[])
+{
+	unsigned long long iterations = 0, bytes = 0;
+	size_t mib = 0;
+	int exit_code = EXIT_SUCCESS;
+	int drain = 0, quiet = 0;
+	int opt;
+
+	/* Stop at the first non-option so that "toy zzz 5" works as before */
+	while ((opt = getopt(argc, argv, "+c:m:rw:x:q")) != -1) {
+		switch (opt) {
+		case 'c':
+			iterations = strtoull(optarg, NULL, 0);
+			break;
+		case 'm':
+			mib = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			drain = 1;
+			break;
+		case 'w':
+			bytes = strtoull(optarg, NULL, 0);
+			break;
+		case 'x':
+			exit_code = atoi(optarg);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		}
+	}
+
+	if (!quiet) {
+		fprintf(stderr, "pid  = %d\n", getpid());
+		fprintf(stderr, "argc = %d\n", argc);
+
+		for (int i = 0; i < argc; i++) {
+			fprintf(stderr, "argv[%d] = %s\n", i, argv[i]);
+		}
+	}
+
+	if (argc - optind > 1 && strcmp(argv[optind], "zzz") == 0) {
+		sleep(atoi(argv[optind + 1]));
+	}
+
+	if (iterations) burn_cpu(iterations);
+	if (mib) touch_memory(mib);
+	if (drain) drain_stdin();
+	if (bytes) write_stdout(bytes);
+
+	if (!quiet) fprintf(stderr, "done!\n");
 
-	return EXIT_SUCCESS;
+	return exit_code;
 }